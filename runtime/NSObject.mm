@@ -25,6 +25,8 @@
 #include "NSObject.h"
 
 #include "objc-weak.h"
+#include "objc-zalloc.h"
+#include "objc-malloc-instance.h"
 #include "DenseMapExtras.h"
 
 #include <malloc/malloc.h>
@@ -42,6 +44,7 @@
 #include <mach/mach.h>
 #include <sys/mman.h>
 #include <execinfo.h>
+#include <dispatch/dispatch.h>
 
 //#include <os/feature_private.h>
 
@@ -123,12 +126,23 @@ static void _initializeSwiftRefcountingThenCallRelease(id objc) {
 
 namespace objc {
     extern int PageCountWarning;
+    extern int PoolSparePageLimit;
+    extern int CoalescingLRUDepth;
+    extern int PoolSampleInterval;
+    extern int PoolBackgroundReleaseThreshold;
 }
 
 namespace {
 
 _Atomic uint32_t numFaults = 0;
 
+// Autorelease pool page allocation counters, reported by
+// _objc_autoreleasePoolGetStatistics.
+explicit_atomic<uint64_t> poolPagesAllocated{0};
+explicit_atomic<uint64_t> poolPagesFreed{0};
+explicit_atomic<uint64_t> poolPagesReused{0};
+explicit_atomic<uint64_t> poolEntriesCoalesced{0};
+
 // The order of these bits is important.
 #define SIDE_TABLE_WEAKLY_REFERENCED (1UL<<0)
 #define SIDE_TABLE_DEALLOCATING      (1UL<<1)  // MSB-ward of weak bit
@@ -494,6 +508,66 @@ objc_destroyWeak(id *location)
   So we now don't touch the storage until deallocation completes.
 */
 
+#if ISA_HAS_INLINE_RC
+/*
+  Lock-free fast path for objc_loadWeakRetained().
+
+  The referent is protected by the calling thread's hazard pointer instead
+  of the side table lock. Once the weak variable has been re-read and still
+  holds the referent after the hazard is published, the referent's memory
+  cannot be freed: clearDeallocating() nils the variable before it calls
+  weak_wait_for_readers(), which waits for our hazard to go away.
+
+  Returns true and sets *result if the load was completed, either with the
+  retained referent or with nil for a deallocating referent.
+  Returns false if the locked path must be used: no hazard record is
+  available, the class has custom retain/release (and therefore possibly a
+  custom retainWeakReference), or the retain count needs the side table.
+*/
+static ALWAYS_INLINE bool
+loadWeakRetainedOptimistic(id *location, id *result)
+{
+    weak_hazard_t *hazard = weak_hazard_for_thread();
+    if (slowpath(!hazard)) return false;
+
+    auto *var = explicit_atomic<id>::from_pointer(location);
+    id obj = var->load(std::memory_order_relaxed);
+    if (_objc_isTaggedPointerOrNil(obj)) {
+        *result = obj;
+        return true;
+    }
+
+    weak_hazard_enter();
+    while (true) {
+        hazard->referent.store(obj, std::memory_order_seq_cst);
+        id check = var->load(std::memory_order_seq_cst);
+        if (fastpath(check == obj)) break;
+        obj = check;
+        if (_objc_isTaggedPointerOrNil(obj)) {
+            weak_hazard_leave(hazard);
+            *result = obj;
+            return true;
+        }
+    }
+
+    bool done = false;
+    bool needsSideTable;
+    if (fastpath(obj->hasNonpointerIsa()  &&  !obj->ISA()->hasCustomRR())) {
+        if (obj->rootTryRetainInline(&needsSideTable)) {
+            *result = obj;
+            done = true;
+        } else if (!needsSideTable) {
+            // Deallocating.
+            *result = nil;
+            done = true;
+        }
+    }
+
+    weak_hazard_leave(hazard);
+    return done;
+}
+#endif
+
 id
 objc_loadWeakRetained(id *location)
 {
@@ -502,7 +576,15 @@ objc_loadWeakRetained(id *location)
     Class cls;
 
     SideTable *table;
-    
+
+#if ISA_HAS_INLINE_RC
+    if (fastpath(!DisableOptimisticWeakLoads)  &&
+        loadWeakRetainedOptimistic(location, &result))
+    {
+        return result;
+    }
+#endif
+
  retry:
     // fixme std::atomic this load
     obj = *location;
@@ -652,6 +734,73 @@ tls_direct(uintptr_t, tls_key::return_autorelease_object,
 tls_direct(const void *, tls_key::return_autorelease_address)
 	ReturnAutoreleaseInfo::tlsReturnAddress;
 
+// Autorelease pool push site sampling, enabled by OBJC_SAMPLE_POOL_SITES.
+// One in every PoolSampleInterval pushes on each thread is sampled. Before
+// every pop, each sampled pool that is still pushed updates its high-water
+// mark. When a sampled pool is popped, its pending entries are counted and
+// their classes tallied, and the result is merged into the record for the
+// pool's push site. The site records are updated without a lock.
+
+#define POOL_SAMPLE_DEPTH 16
+#define POOL_SITE_COUNT 64
+#define POOL_SITE_CLASSES 8
+
+// Per-thread list of sampled pools that are still pushed, oldest first.
+struct pool_sample_list {
+    unsigned pushes;  // pushes since the last sample
+    unsigned count;
+    struct {
+        void *token;
+        const void *site;
+        uint32_t depth;  // depth of the page containing token
+        uint64_t peak;   // most slots used above token so far
+    } samples[POOL_SAMPLE_DEPTH];
+};
+
+struct PoolSiteClass {
+    std::atomic<Class> cls;
+    std::atomic<uint64_t> count;
+};
+
+struct PoolSite {
+    std::atomic<const void *> address;
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> maxEntries;
+    std::atomic<uint64_t> totalEntries;
+    std::atomic<uint64_t> otherClasses;
+    PoolSiteClass classes[POOL_SITE_CLASSES];
+};
+
+static PoolSite poolSites[POOL_SITE_COUNT];
+
+// Autorelease pool entries handed to the background releaser by pop().
+// Each entry is released count+1 times, like a pool entry.
+#define POOL_RELEASE_BATCH_CAPACITY 256
+struct PoolReleaseBatch {
+    PoolReleaseBatch *next;
+    size_t count;
+    struct {
+        id obj;
+        uintptr_t count;
+    } entries[];
+};
+
+// Batches waiting for the background releaser, newest first.
+static explicit_atomic<PoolReleaseBatch *> poolReleaseBatches{nullptr};
+
+static void wakeDeferredDeallocThread(void);
+
+static void pushPoolReleaseBatch(PoolReleaseBatch *batch)
+{
+    PoolReleaseBatch *head = poolReleaseBatches.load(std::memory_order_relaxed);
+    do {
+        batch->next = head;
+    } while (!poolReleaseBatches.compare_exchange_weak(head, batch,
+                                                       std::memory_order_release,
+                                                       std::memory_order_relaxed));
+    wakeDeferredDeallocThread();
+}
+
 BREAKPOINT_FUNCTION(void objc_autoreleaseNoPool(id obj));
 BREAKPOINT_FUNCTION(void objc_autoreleasePoolInvalid(const void *token));
 
@@ -680,24 +829,52 @@ private:
     static tls_direct(AutoreleasePoolPage *, tls_key::autorelease_pool, HotPageDealloc)
         hotPage_;
 	static uint8_t const SCRIBBLE = 0xA3;  // 0xA3A3A3A3 after releasing
-	static size_t const COUNT = SIZE / sizeof(id);
+    static size_t const RELEASE_BATCH = 16;
     static size_t const MAX_FAULTS = 1;
 
-    // SIZE-sizeof(*this) bytes of contents follow
+    // Pages deeper in the chain are larger, so a thread that builds a
+    // very large pool allocates and walks fewer pages:
+    // depth 0-7 is SIZE, depth 8-15 is 4*SIZE, and deeper is 16*SIZE.
+    // A page's size depends only on its depth, which never changes.
+    static uint32_t const GROWTH_DEPTH = 8;
+
+    static size_t sizeForDepth(uint32_t depth) {
+        if (fastpath(depth < GROWTH_DEPTH)  ||  DisablePoolPageGrowth  ||
+            DebugPoolAllocation)
+        {
+            return SIZE;
+        }
+        if (depth < 2*GROWTH_DEPTH) return SIZE * 4;
+        return SIZE * 16;
+    }
+
+    size_t size() const {
+        return sizeForDepth(depth);
+    }
+
+    // size()-sizeof(*this) bytes of contents follow
 
-    static void * operator new(size_t size) {
+    // The page size depends on the new page's depth,
+    // so operator new takes the new page's parent.
+    static void * operator new(size_t size, AutoreleasePoolPage *newParent) {
+        size_t pageSize = sizeForDepth(newParent ? 1+newParent->depth : 0);
         void *result = 0;
-        int r = posix_memalign(&result, SIZE, SIZE);
+        int r = posix_memalign(&result, SIZE, pageSize);
         ASSERT(r == 0);
+        poolPagesAllocated.fetch_add(1, std::memory_order_relaxed);
         return result;
     }
     static void operator delete(void * p) {
+        poolPagesFreed.fetch_add(1, std::memory_order_relaxed);
         return free(p);
     }
+    static void operator delete(void * p, AutoreleasePoolPage *) {
+        operator delete(p);
+    }
 
     inline void protect() {
 #if PROTECT_AUTORELEASEPOOL
-        mprotect(this, SIZE, PROT_READ);
+        mprotect(this, size(), PROT_READ);
         check();
 #endif
     }
@@ -705,7 +882,7 @@ private:
     inline void unprotect() {
 #if PROTECT_AUTORELEASEPOOL
         check();
-        mprotect(this, SIZE, PROT_READ | PROT_WRITE);
+        mprotect(this, size(), PROT_READ | PROT_WRITE);
 #endif
     }
 
@@ -813,7 +990,7 @@ private:
     }
 
     id * end() {
-        return (id *) ((uint8_t *)this+SIZE);
+        return (id *) ((uint8_t *)this+size());
     }
 
     bool empty() {
@@ -839,7 +1016,8 @@ private:
             if (!DisableAutoreleaseCoalescingLRU) {
                 if (!empty() && (obj != POOL_BOUNDARY)) {
                     AutoreleasePoolEntry *topEntry = (AutoreleasePoolEntry *)next - 1;
-                    for (uintptr_t offset = 0; offset < 4; offset++) {
+                    uintptr_t depth = (uintptr_t)objc::CoalescingLRUDepth;
+                    for (uintptr_t offset = 0; offset < depth; offset++) {
                         AutoreleasePoolEntry *offsetEntry = topEntry - offset;
                         if (offsetEntry <= (AutoreleasePoolEntry*)begin() || *(id *)offsetEntry == POOL_BOUNDARY) {
                             break;
@@ -897,7 +1075,63 @@ private:
         releaseUntil(begin());
     }
 
-    void releaseUntil(id *stop) 
+    // Release a batch of entries taken from a page. n is at most
+    // RELEASE_BATCH. The objects' isa words are prefetched first. Objects
+    // without custom RR are released directly, and the ones that must be
+    // deallocated are deallocated after the whole batch has been released.
+    // Objects with custom RR are sent -release immediately as usual.
+    // If offload is set, objects of classes marked with
+    // _class_setThreadAgnosticDealloc are added to *offload instead, for
+    // the background releaser.
+    static void releaseBatch(id *objs, int *counts, size_t n,
+                             PoolReleaseBatch **offload)
+    {
+        id deallocs[RELEASE_BATCH];
+        size_t deallocCount = 0;
+        uint64_t coalesced = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            __builtin_prefetch((void *)objs[i], 1);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            id obj = objs[i];
+            if (obj == POOL_BOUNDARY) continue;
+
+            // release count+1 times since it is count of the additional
+            // autoreleases beyond the first one
+            int releases = counts[i] + 1;
+            coalesced += counts[i];
+            if (slowpath(offload)  &&  !obj->isTaggedPointer()  &&
+                obj->ISA()->hasThreadAgnosticDealloc())
+            {
+                offloadEntry(offload, obj, counts[i]);
+                continue;
+            }
+            if (slowpath(obj->isTaggedPointer()  ||  obj->ISA()->hasCustomRR())) {
+                for (int j = 0; j < releases; j++) {
+                    objc_release(obj);
+                }
+                continue;
+            }
+            for (int j = 0; j < releases; j++) {
+                if (obj->rootReleaseShouldDealloc()) {
+                    deallocs[deallocCount++] = obj;
+                    break;
+                }
+            }
+        }
+
+        if (coalesced) {
+            poolEntriesCoalesced.fetch_add(coalesced, std::memory_order_relaxed);
+        }
+
+        for (size_t i = 0; i < deallocCount; i++) {
+            deallocs[i]->performDealloc();
+        }
+    }
+
+    void releaseUntil(id *stop, PoolReleaseBatch **offload = nil) 
     {
         // Not recursive: we don't want to blow out the stack 
         // if a thread accumulates a stupendous amount of garbage
@@ -914,30 +1148,37 @@ private:
                     setHotPage(page);
                 }
 
+                // Take up to RELEASE_BATCH entries from the top of the page,
+                // but none at or below stop. Objects autoreleased while the
+                // batch is released go on top of the remaining entries and
+                // are released by the next batch.
+                id *batchEnd = page->next;
+                id *batchStart = page == this ? stop : page->begin();
+                if (batchEnd - batchStart > (ptrdiff_t)RELEASE_BATCH) {
+                    batchStart = batchEnd - RELEASE_BATCH;
+                }
+                size_t n = batchEnd - batchStart;
+                id objs[RELEASE_BATCH];
+                int counts[RELEASE_BATCH];
+
                 page->unprotect();
+                for (size_t i = 0; i < n; i++) {
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
-                AutoreleasePoolEntry* entry = (AutoreleasePoolEntry*) --page->next;
+                    AutoreleasePoolEntry* entry = (AutoreleasePoolEntry*)(batchEnd - 1 - i);
 
-                // create an obj with the zeroed out top byte and release that
-                id obj = (id)entry->ptr;
-                int count = (int)entry->count;  // grab these before memset
+                    // create an obj with the zeroed out top byte and release that
+                    objs[i] = (id)entry->ptr;
+                    counts[i] = (int)entry->count;  // grab these before memset
 #else
-                id obj = *--page->next;
+                    objs[i] = batchEnd[-1 - (ptrdiff_t)i];
+                    counts[i] = 0;
 #endif
-                memset((void*)page->next, SCRIBBLE, sizeof(*page->next));
+                }
+                page->next = batchStart;
+                memset((void*)batchStart, SCRIBBLE, n * sizeof(*batchStart));
                 page->protect();
 
-                if (obj != POOL_BOUNDARY) {
-#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
-                    // release count+1 times since it is count of the additional
-                    // autoreleases beyond the first one
-                    for (int i = 0; i < count + 1; i++) {
-                        objc_release(obj);
-                    }
-#else
-                    objc_release(obj);
-#endif
-                }
+                releaseBatch(objs, counts, n, offload);
             }
 
             // Stale return autorelease info is conceptually autoreleased. If
@@ -977,22 +1218,33 @@ private:
         } while (deathptr != this);
     }
 
-    static AutoreleasePoolPage *pageForPointer(const void *p) 
+    // Free every child page after the first `keep` children.
+    // The kept children are empty and are reused by autoreleaseFullPage()
+    // before any new page is allocated. They are freed with the rest
+    // of the thread's pages by HotPageDealloc.
+    void killChildrenAfter(int keep)
     {
-        return pageForPointer((uintptr_t)p);
+        AutoreleasePoolPage *page = this;
+        while (keep-- > 0  &&  page->child) page = page->child;
+        if (page->child) page->child->kill();
     }
 
-    static AutoreleasePoolPage *pageForPointer(uintptr_t p) 
+    // Pages are not all the same size, so rounding p down may land
+    // inside a larger page, among autoreleased pointers that can look
+    // like a page header. Only pages reached through this thread's chain
+    // are trusted instead. Search from the hot page toward the cold page:
+    // p is a pool token, and popping it empties every page the search
+    // passes, so the search costs no more than the pop itself.
+    // Returns nil if p is in none of them.
+    static AutoreleasePoolPage *pageForPointer(const void *p) 
     {
-        AutoreleasePoolPage *result;
-        uintptr_t offset = p % SIZE;
-
-        ASSERT(offset >= sizeof(AutoreleasePoolPage));
-
-        result = (AutoreleasePoolPage *)(p - offset);
-        result->fastcheck();
-
-        return result;
+        for (AutoreleasePoolPage *page = hotPage(); page; page = page->parent) {
+            page->fastcheck();
+            if (p >= (void *)page->begin()  &&  p < (void *)page->end()) {
+                return page;
+            }
+        }
+        return nil;
     }
 
 
@@ -1056,8 +1308,11 @@ private:
         ASSERT(page->full()  ||  DebugPoolAllocation);
 
         do {
-            if (page->child) page = page->child;
-            else page = new AutoreleasePoolPage(page);
+            if (page->child) {
+                page = page->child;
+                poolPagesReused.fetch_add(1, std::memory_order_relaxed);
+            }
+            else page = new (page) AutoreleasePoolPage(page);
         } while (page->full());
 
         setHotPage(page);
@@ -1108,7 +1363,7 @@ private:
         // We are pushing an object or a non-placeholder'd pool.
 
         // Install the first page.
-        AutoreleasePoolPage *page = new AutoreleasePoolPage(nil);
+        AutoreleasePoolPage *page = new (nil) AutoreleasePoolPage(nil);
         setHotPage(page);
 
         // dtrace probe
@@ -1209,13 +1464,64 @@ public:
             _objc_fatal("Invalid autorelease pools are a fatal error");
     }
 
+    // Add one entry to the background releaser's batch, handing the
+    // batch over when it is full.
+    static void
+    offloadEntry(PoolReleaseBatch **offload, id obj, uintptr_t count)
+    {
+        PoolReleaseBatch *batch = *offload;
+        if (!batch) {
+            batch = (PoolReleaseBatch *)
+                malloc(sizeof(PoolReleaseBatch) +
+                       POOL_RELEASE_BATCH_CAPACITY * sizeof(batch->entries[0]));
+            batch->count = 0;
+            *offload = batch;
+        }
+        batch->entries[batch->count].obj = obj;
+        batch->entries[batch->count].count = count;
+        if (++batch->count == POOL_RELEASE_BATCH_CAPACITY) {
+            pushPoolReleaseBatch(batch);
+            *offload = nil;
+        }
+    }
+
+    // Return true if at least PoolBackgroundReleaseThreshold entries are
+    // being popped. Only page bounds are read, not the entries.
+    static bool
+    shouldOffload(AutoreleasePoolPage *page, id *stop)
+    {
+        size_t threshold = (size_t)objc::PoolBackgroundReleaseThreshold;
+        AutoreleasePoolPage *hot = hotPage();
+        size_t pending = 0;
+        for (AutoreleasePoolPage *p = page; p; p = p->child) {
+            pending += p->next - (p == page ? stop : p->begin());
+            if (pending >= threshold) return true;
+            if (p == hot) break;
+        }
+        return false;
+    }
+
     template<bool allowDebug>
     static void
-    popPage(void *token, AutoreleasePoolPage *page, id *stop)
+    popPage(void *token, AutoreleasePoolPage *page, id *stop, bool offload)
     {
         if (allowDebug && PrintPoolHiwat) printHiwat();
 
-        page->releaseUntil(stop);
+        if (slowpath(offload)) {
+            // Entries of thread-agnostic classes are collected while the
+            // rest are released, and go to the background releaser in
+            // fixed-size batches.
+            // The popped pages are not detached and handed over whole:
+            // objects of other classes must be released before pop()
+            // returns, so this thread still reads every entry and its
+            // isa. Offloading saves the release and dealloc work of the
+            // thread-agnostic objects, not the walk over the entries.
+            PoolReleaseBatch *batch = nil;
+            page->releaseUntil(stop, &batch);
+            if (batch) pushPoolReleaseBatch(batch);
+        } else {
+            page->releaseUntil(stop);
+        }
 
         // memory: delete empty children
         if (allowDebug && DebugPoolAllocation  &&  page->empty()) {
@@ -1229,21 +1535,20 @@ public:
             page->kill();
             setHotPage(nil);
         } else if (page->child) {
-            // hysteresis: keep one empty child if page is more than half full
-            if (page->lessThanHalfFull()) {
-                page->child->kill();
-            }
-            else if (page->child->child) {
-                page->child->child->kill();
-            }
+            // hysteresis: keep one empty child if page is more than half full,
+            // plus up to PoolSparePageLimit spare pages for reuse if
+            // OBJC_POOL_SPARE_PAGES is set
+            int keep = objc::PoolSparePageLimit;
+            if (!page->lessThanHalfFull()) keep++;
+            page->killChildrenAfter(keep);
         }
     }
 
     __attribute__((noinline, cold))
     static void
-    popPageDebug(void *token, AutoreleasePoolPage *page, id *stop)
+    popPageDebug(void *token, AutoreleasePoolPage *page, id *stop, bool offload)
     {
-        popPage<true>(token, page, stop);
+        popPage<true>(token, page, stop, offload);
     }
 
     static inline void
@@ -1274,6 +1579,7 @@ public:
             token = page->begin();
         } else {
             page = pageForPointer(token);
+            if (!page) return badPop(token);
         }
 
         stop = (id *)token;
@@ -1289,11 +1595,16 @@ public:
             }
         }
 
+        bool offload = false;
+        if (slowpath(BackgroundPoolReleaseStarted.load(std::memory_order_relaxed))) {
+            offload = shouldOffload(page, stop);
+        }
+
         if (slowpath(PrintPoolHiwat || DebugPoolAllocation || DebugMissingPools)) {
-            return popPageDebug(token, page, stop);
+            return popPageDebug(token, page, stop, offload);
         }
 
-        return popPage<false>(token, page, stop);
+        return popPage<false>(token, page, stop, offload);
     }
 
     __attribute__((noinline, cold))
@@ -1373,7 +1684,10 @@ public:
         // Check and propagate high water mark
         // Ignore high water marks under 256 to suppress noise.
         AutoreleasePoolPage *p = hotPage();
-        uint32_t mark = p->depth*COUNT + (uint32_t)(p->next - p->begin());
+        uint32_t mark = (uint32_t)(p->next - p->begin());
+        for (AutoreleasePoolPage *q = p->parent; q; q = q->parent) {
+            mark += (uint32_t)(q->end() - q->begin());
+        }
         if (mark > p->hiwat + 256) {
 #if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
             unsigned sumOfExtraReleases = 0;
@@ -1410,6 +1724,193 @@ public:
         }
     }
 
+    // Update the high-water mark of every sampled pool that is still
+    // pushed. A pool only shrinks when it or an inner pool is popped, so
+    // checking before every pop finds its peak. Like the pool high water
+    // mark, this counts slots, including the boundaries of inner pools.
+    static void updateSamplePeaks(pool_sample_list *list)
+    {
+        AutoreleasePoolPage *page = hotPage();
+        uint64_t above = 0;  // slots in the pages above page
+        unsigned i = list->count;
+        while (i > 0  &&  page) {
+            auto &sample = list->samples[i - 1];
+            if (sample.token != (void *)EMPTY_POOL_PLACEHOLDER  &&
+                sample.depth >= page->depth)
+            {
+                uint64_t slots = above;
+                if (sample.depth == page->depth) {
+                    slots += page->next - ((id *)sample.token + 1);
+                }
+                if (slots > sample.peak) sample.peak = slots;
+                i--;
+                continue;
+            }
+            above += page->next - page->begin();
+            page = page->parent;
+        }
+        // The placeholder pool is the outermost pool and holds everything.
+        if (i > 0  &&  above > list->samples[0].peak) {
+            list->samples[0].peak = above;
+        }
+    }
+
+    // Count the entries pending in the pool whose token is `token`
+    // and merge the count and their classes into the site's record,
+    // along with the pool's high-water mark `peak`.
+    static void recordSample(const void *site, void *token, uint64_t peak)
+    {
+        AutoreleasePoolPage *page;
+        id *p;
+        if (token == (void *)EMPTY_POOL_PLACEHOLDER) {
+            page = coldPage();
+            p = page ? page->begin() : nil;
+        } else {
+            page = pageForPointer(token);
+            p = (id *)token + 1;  // skip the pool's own boundary
+        }
+
+        struct { Class cls; uint64_t count; } classes[POOL_SITE_CLASSES] = {};
+        uint64_t otherClasses = 0;
+        uint64_t entries = 0;
+        for (AutoreleasePoolPage *start = page; page; page = page->child) {
+            if (page != start) p = page->begin();
+            for (; p < page->next; p++) {
+                if (*p == POOL_BOUNDARY) continue;
+#if SUPPORT_AUTORELEASEPOOL_DEDUP_PTRS
+                AutoreleasePoolEntry *entry = (AutoreleasePoolEntry *)p;
+                objc_object *obj = (objc_object *)entry->ptr;
+                uint64_t count = entry->count + 1;
+#else
+                objc_object *obj = (objc_object *)*p;
+                uint64_t count = 1;
+#endif
+                entries += count;
+                Class cls = obj->getIsa();
+                unsigned i;
+                for (i = 0; i < POOL_SITE_CLASSES; i++) {
+                    if (!classes[i].cls) classes[i].cls = cls;
+                    if (classes[i].cls == cls) {
+                        classes[i].count += count;
+                        break;
+                    }
+                }
+                if (i == POOL_SITE_CLASSES) otherClasses += count;
+            }
+        }
+
+        // Find or claim the site's record.
+        PoolSite *record = nil;
+        uintptr_t hash = ((uintptr_t)site >> 2) ^ ((uintptr_t)site >> 12);
+        for (unsigned n = 0; n < POOL_SITE_COUNT; n++) {
+            PoolSite *candidate = &poolSites[(hash + n) % POOL_SITE_COUNT];
+            const void *address = candidate->address.load(std::memory_order_acquire);
+            if (!address  &&
+                candidate->address.compare_exchange_strong(address, site,
+                                                           std::memory_order_acq_rel))
+            {
+                address = site;
+            }
+            if (address == site) {
+                record = candidate;
+                break;
+            }
+        }
+        if (!record) return;  // table is full
+
+        record->samples.fetch_add(1, std::memory_order_relaxed);
+        record->totalEntries.fetch_add(entries, std::memory_order_relaxed);
+        if (entries > peak) peak = entries;
+        uint64_t max = record->maxEntries.load(std::memory_order_relaxed);
+        while (peak > max  &&
+               !record->maxEntries.compare_exchange_weak(max, peak,
+                                                         std::memory_order_relaxed))
+            ;
+
+        for (unsigned i = 0; i < POOL_SITE_CLASSES  &&  classes[i].cls; i++) {
+            unsigned j;
+            for (j = 0; j < POOL_SITE_CLASSES; j++) {
+                PoolSiteClass &slot = record->classes[j];
+                Class cls = slot.cls.load(std::memory_order_acquire);
+                if (!cls  &&
+                    slot.cls.compare_exchange_strong(cls, classes[i].cls,
+                                                     std::memory_order_acq_rel))
+                {
+                    cls = classes[i].cls;
+                }
+                if (cls == classes[i].cls) {
+                    slot.count.fetch_add(classes[i].count, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            if (j == POOL_SITE_CLASSES) otherClasses += classes[i].count;
+        }
+        if (otherClasses) {
+            record->otherClasses.fetch_add(otherClasses, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    static void *pushSampled(const void *site)
+    {
+        void *token = push();
+
+        _objc_pthread_data *data = _objc_fetch_pthread_data(true);
+        if (!data) return token;
+        pool_sample_list *list = data->poolSamples;
+        if (!list) {
+            list = (pool_sample_list *)calloc(1, sizeof(*list));
+            data->poolSamples = list;
+        }
+        if (++list->pushes < (unsigned)objc::PoolSampleInterval  ||
+            list->count == POOL_SAMPLE_DEPTH)
+        {
+            return token;
+        }
+        list->pushes = 0;
+        AutoreleasePoolPage *page = nil;
+        if (token != (void *)EMPTY_POOL_PLACEHOLDER) {
+            page = pageForPointer(token);
+        }
+        list->samples[list->count].token = token;
+        list->samples[list->count].site = site;
+        list->samples[list->count].depth = page ? page->depth : 0;
+        list->samples[list->count].peak = 0;
+        list->count++;
+        return token;
+    }
+
+    // Called before popping `token`. Records every sampled pool
+    // that the pop releases, including inner pools popped with it.
+    static void popSampled(void *token)
+    {
+        _objc_pthread_data *data = _objc_fetch_pthread_data(false);
+        pool_sample_list *list = data ? data->poolSamples : nil;
+        if (!list  ||  list->count == 0) return;
+
+        updateSamplePeaks(list);
+
+        // The placeholder pool is always the outermost pool.
+        bool popAll = (token == (void *)EMPTY_POOL_PLACEHOLDER);
+        AutoreleasePoolPage *page = popAll ? nil : pageForPointer(token);
+        if (!popAll  &&  !page) return;  // pop() will report the bad token
+
+        while (list->count > 0) {
+            auto &sample = list->samples[list->count - 1];
+            if (!popAll) {
+                if (sample.token == (void *)EMPTY_POOL_PLACEHOLDER) break;
+                if (sample.depth < page->depth  ||
+                    (sample.depth == page->depth  &&  sample.token < token))
+                {
+                    // Sampled pool is outside the popped pool.
+                    break;
+                }
+            }
+            recordSample(sample.site, sample.token, sample.peak);
+            list->count--;
+        }
+    }
+
 #undef POOL_BOUNDARY
 
     friend struct ReturnAutoreleaseInfo::TlsDealloc;
@@ -1502,7 +2003,8 @@ objc_object::clearDeallocating_slow()
 
     SideTable& table = SideTables()[this];
     table.lock();
-    if (isa().weakly_referenced) {
+    bool weaklyReferenced = isa().weakly_referenced;
+    if (weaklyReferenced) {
         weak_clear_no_lock(&table.weak_table, (id)this);
     }
 #if ISA_HAS_INLINE_RC
@@ -1513,6 +2015,8 @@ objc_object::clearDeallocating_slow()
     }
 #endif
     table.unlock();
+
+    if (weaklyReferenced) weak_wait_for_readers(this);
 }
 
 #endif
@@ -1861,15 +2365,19 @@ objc_object::sidetable_clearDeallocating()
     // clear any weak table items
     // clear extra retain count and deallocating bit
     // (fixme warn or abort if extra retain count == 0 ?)
+    bool weaklyReferenced = false;
     table.lock();
     RefcountMap::iterator it = table.refcnts.find(this);
     if (it != table.refcnts.end()) {
         if (it->second & SIDE_TABLE_WEAKLY_REFERENCED) {
             weak_clear_no_lock(&table.weak_table, (id)this);
+            weaklyReferenced = true;
         }
         table.refcnts.erase(it);
     }
     table.unlock();
+
+    if (weaklyReferenced) weak_wait_for_readers(this);
 }
 
 
@@ -2187,6 +2695,9 @@ _objc_rootHash(id obj)
 void *
 objc_autoreleasePoolPush(void)
 {
+    if (slowpath(objc::PoolSampleInterval)) {
+        return AutoreleasePoolPage::pushSampled(__builtin_return_address(0));
+    }
     return AutoreleasePoolPage::push();
 }
 
@@ -2194,6 +2705,9 @@ NEVER_INLINE
 void
 objc_autoreleasePoolPop(void *ctxt)
 {
+    if (slowpath(objc::PoolSampleInterval)) {
+        AutoreleasePoolPage::popSampled(ctxt);
+    }
     AutoreleasePoolPage::pop(ctxt);
 }
 
@@ -2216,6 +2730,80 @@ _objc_autoreleasePoolPrint(void)
     AutoreleasePoolPage::printAll();
 }
 
+unsigned
+_objc_autoreleasePoolCopySites(objc_autoreleasepool_site_t *sites,
+                               unsigned count)
+{
+    unsigned result = 0;
+    for (unsigned i = 0; i < POOL_SITE_COUNT; i++) {
+        PoolSite &site = poolSites[i];
+        const void *address = site.address.load(std::memory_order_acquire);
+        if (!address) continue;
+        if (result < count) {
+            objc_autoreleasepool_site_t &out = sites[result];
+            out.address = address;
+            out.samples = site.samples.load(std::memory_order_relaxed);
+            out.maxEntries = site.maxEntries.load(std::memory_order_relaxed);
+            out.totalEntries = site.totalEntries.load(std::memory_order_relaxed);
+            out.otherClasses = site.otherClasses.load(std::memory_order_relaxed);
+            for (unsigned j = 0; j < POOL_SITE_CLASSES; j++) {
+                out.classes[j].cls = site.classes[j].cls.load(std::memory_order_acquire);
+                out.classes[j].count = site.classes[j].count.load(std::memory_order_relaxed);
+            }
+        }
+        result++;
+    }
+    return result;
+}
+
+void
+_objc_autoreleasePoolPrintSites(void)
+{
+    objc_autoreleasepool_site_t sites[POOL_SITE_COUNT];
+    unsigned count = _objc_autoreleasePoolCopySites(sites, POOL_SITE_COUNT);
+    std::sort(sites, sites + count, [](const objc_autoreleasepool_site_t &a,
+                                       const objc_autoreleasepool_site_t &b) {
+        return a.maxEntries > b.maxEntries;
+    });
+
+    _objc_inform("##############");
+    _objc_inform("AUTORELEASE POOL SITES (%u)", count);
+    for (unsigned i = 0; i < count; i++) {
+        const objc_autoreleasepool_site_t &site = sites[i];
+        const char *symbol = "";
+#if !TARGET_OS_EXCLAVEKIT
+        Dl_info info;
+        if (dladdr(site.address, &info)  &&  info.dli_sname) {
+            symbol = info.dli_sname;
+        }
+#endif
+        _objc_inform("POOL SITE %p %s: %llu samples, high water %llu, "
+                     "average %llu entries", site.address, symbol,
+                     (unsigned long long)site.samples,
+                     (unsigned long long)site.maxEntries,
+                     (unsigned long long)(site.samples ? site.totalEntries / site.samples : 0));
+        for (unsigned j = 0; j < POOL_SITE_CLASSES  &&  site.classes[j].cls; j++) {
+            _objc_inform("POOL SITE     %10llu  %s",
+                         (unsigned long long)site.classes[j].count,
+                         class_getName(site.classes[j].cls));
+        }
+        if (site.otherClasses) {
+            _objc_inform("POOL SITE     %10llu  (other classes)",
+                         (unsigned long long)site.otherClasses);
+        }
+    }
+    _objc_inform("##############");
+}
+
+void
+_objc_autoreleasePoolGetStatistics(objc_autoreleasepool_statistics_t *stats)
+{
+    stats->pagesAllocated = poolPagesAllocated.load(std::memory_order_relaxed);
+    stats->pagesFreed = poolPagesFreed.load(std::memory_order_relaxed);
+    stats->pagesReused = poolPagesReused.load(std::memory_order_relaxed);
+    stats->entriesCoalesced = poolEntriesCoalesced.load(std::memory_order_relaxed);
+}
+
 
 // Same as objc_release but suitable for tail-calling 
 // if you need the value back and don't want to push a frame before this point.
@@ -2306,6 +2894,492 @@ _objc_deallocOnMainThreadHelper(void *context)
     [obj dealloc];
 }
 
+
+/***********************************************************************
+* Deferred deallocation
+* object_dispose() of an instance of a class marked with
+* _class_setDeferredDeallocation() (or of any instance when
+* OBJC_DEFER_DEALLOCATION is set) clears the object's weak references and
+* side table state on the calling thread, and then pushes the object onto a
+* bounded lock-free queue. A background thread drains the queue, running
+* C++ destructors, removing associations, and freeing the memory.
+*
+* The queue is a bounded multi-producer single-consumer ring. Each slot
+* carries a sequence number; a producer claims a slot with one CAS on the
+* tail, and the consumer is the only thread that advances the head. When
+* the ring is full, object_dispose() falls back to destroying the object
+* synchronously, so the queue never blocks the releasing thread.
+*
+* When it runs out of work the thread marks itself idle and waits on a
+* semaphore. A producer signals the semaphore only if it finds the thread
+* idle, so a busy thread costs producers no system calls.
+*
+* The same thread also releases autorelease pool entries that pop()
+* handed off for classes marked with _class_setThreadAgnosticDealloc().
+**********************************************************************/
+
+explicit_atomic<bool> DeferredDeallocationStarted{false};
+explicit_atomic<bool> BackgroundPoolReleaseStarted{false};
+
+#if !TARGET_OS_EXCLAVEKIT
+
+namespace {
+
+class DeferredDeallocQueue {
+    static constexpr uintptr_t Capacity = 4096;
+    static constexpr uintptr_t Mask = Capacity - 1;
+    static_assert((Capacity & Mask) == 0, "Capacity must be a power of two");
+
+    struct Slot {
+        explicit_atomic<uintptr_t> sequence;
+        id obj;
+    };
+
+    // The tail is written by every producer and the head only by the
+    // consumer. Keep them on separate cache lines.
+    alignas(64) explicit_atomic<uintptr_t> tail;
+    alignas(64) uintptr_t head;
+    Slot slots[Capacity];
+
+public:
+    DeferredDeallocQueue() : tail(0), head(0) {
+        for (uintptr_t i = 0; i < Capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+            slots[i].obj = nil;
+        }
+    }
+
+    // Returns false if the queue is full.
+    bool push(id obj) {
+        uintptr_t pos = tail.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[pos & Mask];
+            uintptr_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->obj = obj;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only.
+    bool empty() {
+        Slot *slot = &slots[head & Mask];
+        return slot->sequence.load(std::memory_order_relaxed) != head + 1;
+    }
+
+    // Consumer only. Returns nil if the queue is empty.
+    id pop() {
+        Slot *slot = &slots[head & Mask];
+        if (slot->sequence.load(std::memory_order_acquire) != head + 1)
+            return nil;
+        id obj = slot->obj;
+        slot->sequence.store(head + Capacity, std::memory_order_release);
+        head++;
+        return obj;
+    }
+};
+
+explicit_atomic<DeferredDeallocQueue *> deferredDeallocQueue{nullptr};
+
+dispatch_semaphore_t deferredDeallocSemaphore;
+explicit_atomic<bool> deferredDeallocIdle{false};
+explicit_atomic<bool> deferredDeallocThreadStarting{false};
+
+}
+
+// Called after handing work to the background thread.
+static void wakeDeferredDeallocThread(void)
+{
+    // Pairs with the fence in deferredDeallocThread(). Either the thread
+    // sees our work, or we see that it is idle.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (deferredDeallocIdle.load(std::memory_order_relaxed)  &&
+        deferredDeallocIdle.exchange(false, std::memory_order_relaxed))
+    {
+        dispatch_semaphore_signal(deferredDeallocSemaphore);
+    }
+}
+
+static void destroyDeferredInstance(id obj)
+{
+    // Weak references and side table state were already cleared by
+    // _object_deferDispose(). This is the rest of objc_destructInstance().
+    bool cxx = obj->hasCxxDtor();
+    bool assoc = obj->hasAssociatedObjects();
+
+    Class cls = obj->ISA();
+    if (cxx) object_cxxDestruct(obj);
+    if (assoc) _object_remove_associations(obj, /*deallocating*/true);
+    if (slowpath(PooledInstancesEnabled.load(std::memory_order_relaxed))  &&
+        cls->hasPooledInstances())
+    {
+        _objc_freePooledInstance(obj, cls);
+    } else {
+        free(obj);
+    }
+}
+
+// Release the autorelease pool entries handed off by
+// AutoreleasePoolPage::releaseUntil().
+static void releasePoolBatches()
+{
+    PoolReleaseBatch *batch =
+        poolReleaseBatches.exchange(nullptr, std::memory_order_acquire);
+    while (batch) {
+        for (size_t i = 0; i < batch->count; i++) {
+            for (uintptr_t j = 0; j < batch->entries[i].count + 1; j++) {
+                objc_release(batch->entries[i].obj);
+            }
+        }
+        PoolReleaseBatch *next = batch->next;
+        free(batch);
+        batch = next;
+    }
+}
+
+static void *deferredDeallocThread(void *arg) {
+    pthread_setname_np("ObjC deferred deallocation");
+
+    auto *queue = (DeferredDeallocQueue *)arg;
+    while (true) {
+        releasePoolBatches();
+        while (id obj = queue->pop()) {
+            destroyDeferredInstance(obj);
+        }
+
+        // Go idle, then look for work once more, in case it arrived
+        // before the producer could see that we were idle.
+        deferredDeallocIdle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue->empty()  &&
+            !poolReleaseBatches.load(std::memory_order_relaxed))
+        {
+            dispatch_semaphore_wait(deferredDeallocSemaphore,
+                                    DISPATCH_TIME_FOREVER);
+        } else if (!deferredDeallocIdle.exchange(false,
+                                                 std::memory_order_relaxed))
+        {
+            // A producer saw us idle and is signaling. Take the signal
+            // so the next wait doesn't return early.
+            dispatch_semaphore_wait(deferredDeallocSemaphore,
+                                    DISPATCH_TIME_FOREVER);
+        }
+    }
+}
+
+// Start the thread that destroys deferred instances and releases
+// offloaded autorelease pool entries. Only the first call starts it.
+static void startDeferredDeallocThread(void)
+{
+    if (deferredDeallocThreadStarting.exchange(true, std::memory_order_relaxed))
+        return;
+
+    deferredDeallocSemaphore = dispatch_semaphore_create(0);
+    auto *queue = new DeferredDeallocQueue;
+    deferredDeallocQueue.store(queue, std::memory_order_release);
+
+    pthread_t thread;
+    int ret = pthread_create(&thread, nullptr, deferredDeallocThread, queue);
+    if (ret != 0)
+        _objc_fatal("pthread_create failed with error %d (%s)", ret, strerror(ret));
+    pthread_detach(thread);
+}
+
+void _objc_startDeferredDeallocation(void)
+{
+    startDeferredDeallocThread();
+    DeferredDeallocationStarted.store(true, std::memory_order_relaxed);
+}
+
+void _objc_startBackgroundPoolRelease(void)
+{
+    startDeferredDeallocThread();
+    BackgroundPoolReleaseStarted.store(true, std::memory_order_relaxed);
+}
+
+// The background thread does not exist in a forked child. Objects and
+// pool entries still queued for it are leaked, and new ones are destroyed
+// synchronously until deferred deallocation or background pool release
+// is requested again, which starts a new thread with a new queue.
+void _objc_deferredDeallocAtforkChild(void)
+{
+    DeferredDeallocationStarted.store(false, std::memory_order_relaxed);
+    BackgroundPoolReleaseStarted.store(false, std::memory_order_relaxed);
+    deferredDeallocQueue.store(nullptr, std::memory_order_relaxed);
+    poolReleaseBatches.store(nullptr, std::memory_order_relaxed);
+    deferredDeallocIdle.store(false, std::memory_order_relaxed);
+    deferredDeallocThreadStarting.store(false, std::memory_order_relaxed);
+}
+
+bool _object_deferDispose(id obj)
+{
+    ASSERT(!obj->isTaggedPointer());
+
+    // Raw isa objects keep their deallocating state in the side table,
+    // which must stay intact until the object is destroyed.
+    if (!obj->hasNonpointerIsa()) return false;
+    if (!DeferDeallocation  &&  !obj->ISA()->hasDeferredDeallocation())
+        return false;
+
+    // Clear weak references now, so they read as nil as soon as
+    // object_dispose() returns, exactly as with synchronous deallocation.
+    obj->clearDeallocating();
+
+    auto *queue = deferredDeallocQueue.load(std::memory_order_acquire);
+    if (queue  &&  queue->push(obj)) {
+        wakeDeferredDeallocThread();
+        return true;
+    }
+
+    // The queue is full. Destroy the object here instead.
+    destroyDeferredInstance(obj);
+    return true;
+}
+
+#else
+
+static void wakeDeferredDeallocThread(void) { }
+void _objc_startDeferredDeallocation(void) { }
+void _objc_startBackgroundPoolRelease(void) { }
+void _objc_deferredDeallocAtforkChild(void) { }
+bool _object_deferDispose(id) { return false; }
+
+#endif // !TARGET_OS_EXCLAVEKIT
+
+
+/***********************************************************************
+* Instance pools
+* Instances of classes marked with _class_setPooledInstances() are not
+* freed. Their memory goes on the freeing thread's list for its size
+* class, and the next allocation of a marked class of that size on that
+* thread reuses it. Memory is only pooled after objc_destructInstance()
+* or its equivalent, so weak references are already cleared and the
+* object's side table entry is gone.
+*
+* Thread lists are linked through the first word of each block. When a
+* thread's list reaches twice INSTANCE_POOL_BATCH, a batch of
+* INSTANCE_POOL_BATCH blocks moves to the global pool for the size
+* class. A thread whose list is empty takes one batch back. Global
+* batches are linked through the first word of their first block. The
+* blocks within a batch are linked through their second word. The global
+* pool holds at most INSTANCE_POOL_MAX_BATCHES per size class. Batches
+* beyond that are freed.
+*
+* Every pooled block is at least as large as its size class, so any
+* marked class of that size class can reuse it.
+*
+* PooledInstancesEnabled is set before the first class is marked, so
+* allocation and deallocation of everything else skip the class's flag
+* load. Pooling is off under typed malloc: the pools would hand one
+* class's memory to another, which typed allocation exists to prevent.
+**********************************************************************/
+
+explicit_atomic<bool> PooledInstancesEnabled{false};
+
+#define INSTANCE_POOL_GRANULE 16
+#define INSTANCE_POOL_CLASSES 16  // up to 256 bytes
+#define INSTANCE_POOL_BATCH 32
+#define INSTANCE_POOL_MAX_BATCHES 64
+
+struct instance_pool_t {
+    struct {
+        void *head;
+        unsigned count;
+    } lists[INSTANCE_POOL_CLASSES];
+
+    // Counts not yet added to the global statistics.
+    uint64_t allocations;
+    uint64_t hits;
+    uint64_t frees;
+    intptr_t retainedBytes;
+};
+
+// The global pool of one size class.
+struct instance_pool_class_t {
+    objc::AtomicQueue batches;
+    explicit_atomic<unsigned> batchCount{0};
+};
+
+static instance_pool_class_t instancePoolClasses[INSTANCE_POOL_CLASSES];
+
+static explicit_atomic<uint64_t> instancePoolAllocations{0};
+static explicit_atomic<uint64_t> instancePoolHits{0};
+static explicit_atomic<uint64_t> instancePoolFrees{0};
+static explicit_atomic<intptr_t> instancePoolRetainedBytes{0};
+
+static inline void *&instancePoolNext(void *block) {
+    return ((void **)block)[0];
+}
+
+static inline void *&instancePoolBatchNext(void *block) {
+    return ((void **)block)[1];
+}
+
+static inline unsigned instancePoolIndex(size_t size) {
+    return (unsigned)((size - 1) / INSTANCE_POOL_GRANULE);
+}
+
+static inline size_t instancePoolBlockSize(unsigned index) {
+    return (index + 1) * INSTANCE_POOL_GRANULE;
+}
+
+static instance_pool_t *instancePoolForThread(void)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(true);
+    if (!data) return nil;
+    if (!data->instancePool) {
+        data->instancePool = (instance_pool_t *)calloc(1, sizeof(instance_pool_t));
+    }
+    return data->instancePool;
+}
+
+static void instancePoolFlushStatistics(instance_pool_t *pool)
+{
+    instancePoolAllocations.fetch_add(pool->allocations, std::memory_order_relaxed);
+    instancePoolHits.fetch_add(pool->hits, std::memory_order_relaxed);
+    instancePoolFrees.fetch_add(pool->frees, std::memory_order_relaxed);
+    instancePoolRetainedBytes.fetch_add(pool->retainedBytes, std::memory_order_relaxed);
+    pool->allocations = 0;
+    pool->hits = 0;
+    pool->frees = 0;
+    pool->retainedBytes = 0;
+}
+
+// Moves a list of blocks, linked through their first words,
+// to the global pool as one batch, or frees it if the pool is full.
+static void instancePoolGiveBatch(instance_pool_t *pool, unsigned index,
+                                  void *head, unsigned count)
+{
+    instance_pool_class_t &global = instancePoolClasses[index];
+    unsigned batches = global.batchCount.fetch_add(1, std::memory_order_relaxed);
+    if (batches >= INSTANCE_POOL_MAX_BATCHES) {
+        global.batchCount.fetch_sub(1, std::memory_order_relaxed);
+        while (head) {
+            void *next = instancePoolNext(head);
+            free(head);
+            head = next;
+        }
+        pool->retainedBytes -= (intptr_t)(count * instancePoolBlockSize(index));
+        return;
+    }
+
+    for (void *block = head; block; block = instancePoolNext(block)) {
+        instancePoolBatchNext(block) = instancePoolNext(block);
+    }
+    global.batches.push(head);
+}
+
+id _objc_allocPooledInstance(Class cls, size_t size)
+{
+    unsigned index = instancePoolIndex(size);
+    instance_pool_t *pool;
+    if (index >= INSTANCE_POOL_CLASSES  ||  !(pool = instancePoolForThread())) {
+        return objc::malloc_instance(size, cls);
+    }
+
+    pool->allocations++;
+    auto &list = pool->lists[index];
+    if (!list.head) {
+        instance_pool_class_t &global = instancePoolClasses[index];
+        void *batch = global.batches.pop();
+        if (batch) {
+            global.batchCount.fetch_sub(1, std::memory_order_relaxed);
+            unsigned count = 0;
+            for (void *block = batch; block; block = instancePoolNext(block)) {
+                instancePoolNext(block) = instancePoolBatchNext(block);
+                count++;
+            }
+            list.head = batch;
+            list.count = count;
+            instancePoolFlushStatistics(pool);
+        }
+    }
+
+    void *block = list.head;
+    if (!block) {
+        // Allocate the whole size class so the block can be pooled later.
+        return objc::malloc_instance(instancePoolBlockSize(index), cls);
+    }
+
+    list.head = instancePoolNext(block);
+    list.count--;
+    pool->hits++;
+    pool->retainedBytes -= (intptr_t)instancePoolBlockSize(index);
+    bzero(block, size);
+    return (id)block;
+}
+
+void _objc_freePooledInstance(id obj, Class cls)
+{
+    unsigned index = instancePoolIndex(cls->instanceSize(0));
+    instance_pool_t *pool;
+    if (index >= INSTANCE_POOL_CLASSES  ||
+        // Instances allocated before the class was marked, or by
+        // class_createInstances, may be smaller than their size class.
+        malloc_size(obj) < instancePoolBlockSize(index)  ||
+        !(pool = instancePoolForThread()))
+    {
+        free(obj);
+        return;
+    }
+
+    pool->frees++;
+    pool->retainedBytes += (intptr_t)instancePoolBlockSize(index);
+    auto &list = pool->lists[index];
+    instancePoolNext(obj) = list.head;
+    list.head = obj;
+    if (++list.count < 2 * INSTANCE_POOL_BATCH) return;
+
+    void *head = list.head;
+    void *tail = head;
+    for (unsigned i = 1; i < INSTANCE_POOL_BATCH; i++) {
+        tail = instancePoolNext(tail);
+    }
+    list.head = instancePoolNext(tail);
+    list.count -= INSTANCE_POOL_BATCH;
+    instancePoolNext(tail) = nil;
+    instancePoolGiveBatch(pool, index, head, INSTANCE_POOL_BATCH);
+    instancePoolFlushStatistics(pool);
+}
+
+void _objc_instancePoolDestroy(instance_pool_t *pool)
+{
+    if (!pool) return;
+    for (unsigned i = 0; i < INSTANCE_POOL_CLASSES; i++) {
+        if (pool->lists[i].head) {
+            instancePoolGiveBatch(pool, i, pool->lists[i].head,
+                                  pool->lists[i].count);
+        }
+    }
+    instancePoolFlushStatistics(pool);
+    free(pool);
+}
+
+void _objc_getInstancePoolStatistics(objc_instance_pool_statistics_t *stats)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(false);
+    if (data  &&  data->instancePool) {
+        instancePoolFlushStatistics(data->instancePool);
+    }
+
+    stats->allocations = instancePoolAllocations.load(std::memory_order_relaxed);
+    stats->hits = instancePoolHits.load(std::memory_order_relaxed);
+    stats->frees = instancePoolFrees.load(std::memory_order_relaxed);
+    intptr_t retained = instancePoolRetainedBytes.load(std::memory_order_relaxed);
+    stats->retainedBytes = retained > 0 ? (uint64_t)retained : 0;
+}
+
 // convert objc_objectptr_t to id, callee must take ownership.
 id objc_retainedObject(objc_objectptr_t pointer) { return (id)pointer; }
 
@@ -2315,6 +3389,42 @@ id objc_unretainedObject(objc_objectptr_t pointer) { return (id)pointer; }
 // convert id to objc_objectptr_t, no ownership transfer.
 objc_objectptr_t objc_unretainedPointer(id object) { return object; }
 
+unsigned
+_objc_weak_getStatistics(objc_weak_statistics_t *stats, unsigned count)
+{
+    unsigned index = 0;
+    SideTables().forEach([&](SideTable &table) {
+        if (!stats  ||  index >= count) {
+            index++;
+            return;
+        }
+
+        objc_weak_statistics_t &result = stats[index++];
+        bzero(&result, sizeof(result));
+
+        table.lock();
+
+        weak_table_t &weak_table = table.weak_table;
+        result.entries = weak_table.num_entries;
+        result.capacity = weak_table.mask ? weak_table.mask + 1 : 0;
+        result.maxProbeLength = weak_table.max_hash_displacement;
+        result.growCount = weak_table.grow_count;
+        result.compactCount = weak_table.compact_count;
+        result.clearCount = weak_table.clear_count;
+        result.clearNanoseconds = weak_table.clear_nanoseconds;
+        result.maxClearNanoseconds = weak_table.max_clear_nanoseconds;
+        result.referrers = weak_table.num_referrers;
+        static_assert(sizeof(result.referrersHistogram) ==
+                      sizeof(weak_table.referrers_histogram),
+                      "weak referrer histograms must match");
+        memcpy(result.referrersHistogram, weak_table.referrers_histogram,
+               sizeof(result.referrersHistogram));
+
+        table.unlock();
+    });
+    return index;
+}
+
 #if !TARGET_OS_EXCLAVEKIT
 static void *weakTableScan(void *) {
     pthread_setname_np("ObjC weak reference scanner");
@@ -2377,6 +3487,12 @@ void arr_init(void)
     if (DebugScanWeakTables)
         startWeakTableScan();
 #endif
+
+    if (DeferDeallocation)
+        _objc_startDeferredDeallocation();
+
+    if (objc::PoolBackgroundReleaseThreshold)
+        _objc_startBackgroundPoolRelease();
 }
 
 
@@ -232,4 +232,83 @@ public:
     }
 };
 
+// .. objc_rwlock_t ....................................................
+
+// Writers take priority over new readers, so a stream of readers can't
+// starve a writer. Shared holds are not recursive.
+class objc_rwlock_base_t : nocopy_t {
+    mtx_t lock_;
+    cnd_t cond_;
+    int readers_;         // shared holders, or -1 when held exclusively
+    int waitingWriters_;
+
+    void init() {
+        mtx_init(&lock_, mtx_plain);
+        cnd_init(&cond_);
+        readers_ = 0;
+        waitingWriters_ = 0;
+    }
+public:
+    objc_rwlock_base_t() {
+        init();
+    }
+    ~objc_rwlock_base_t() {
+        cnd_destroy(&cond_);
+        mtx_destroy(&lock_);
+    }
+
+    void lock() {
+        mtx_lock(&lock_);
+        waitingWriters_++;
+        while (readers_ != 0) cnd_wait(&cond_, &lock_);
+        waitingWriters_--;
+        readers_ = -1;
+        mtx_unlock(&lock_);
+    }
+
+    bool tryLock() {
+        mtx_lock(&lock_);
+        bool result = (readers_ == 0);
+        if (result) readers_ = -1;
+        mtx_unlock(&lock_);
+        return result;
+    }
+
+    void unlock() {
+        mtx_lock(&lock_);
+        readers_ = 0;
+        cnd_broadcast(&cond_);
+        mtx_unlock(&lock_);
+    }
+
+    void lockShared() {
+        mtx_lock(&lock_);
+        while (readers_ < 0  ||  waitingWriters_ > 0) {
+            cnd_wait(&cond_, &lock_);
+        }
+        readers_++;
+        mtx_unlock(&lock_);
+    }
+
+    bool tryLockShared() {
+        mtx_lock(&lock_);
+        bool result = (readers_ >= 0  &&  waitingWriters_ == 0);
+        if (result) readers_++;
+        mtx_unlock(&lock_);
+        return result;
+    }
+
+    void unlockShared() {
+        mtx_lock(&lock_);
+        if (--readers_ == 0) cnd_broadcast(&cond_);
+        mtx_unlock(&lock_);
+    }
+
+    void reset() {
+        memset(&lock_, 0, sizeof(lock_));
+        memset(&cond_, 0, sizeof(cond_));
+        init();
+    }
+};
+
 #endif // _OBJC_C11THREADS_H
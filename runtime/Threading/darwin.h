@@ -59,6 +59,8 @@ ALWAYS_INLINE pthread_key_t tls_get_key(tls_key k) {
     case tls_key::return_autorelease_address:
         return __PTK_FRAMEWORK_OBJC_KEY5;
 #endif
+    case tls_key::weak_hazard:
+        return __PTK_FRAMEWORK_OBJC_KEY6;
     }
 }
 
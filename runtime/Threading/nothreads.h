@@ -141,4 +141,19 @@ public:
     void hardReset() {}
 };
 
+// .. objc_rwlock_t ....................................................
+
+class objc_rwlock_base_t : nocopy_t {
+public:
+    objc_rwlock_base_t() {}
+
+    void lock() {}
+    bool tryLock() { return true; }
+    void unlock() {}
+    void lockShared() {}
+    bool tryLockShared() { return true; }
+    void unlockShared() {}
+    void reset() {}
+};
+
 #endif // _OBJC_NOTHREADS_H
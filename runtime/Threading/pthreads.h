@@ -242,4 +242,44 @@ public:
 };
 #endif // !_OBJC_PTHREAD_IS_DARWIN
 
+// .. objc_rwlock_t ....................................................
+
+class objc_rwlock_base_t : nocopy_t {
+    pthread_rwlock_t lock_;
+public:
+    objc_rwlock_base_t() : lock_(PTHREAD_RWLOCK_INITIALIZER) {}
+    ~objc_rwlock_base_t() {
+        pthread_rwlock_destroy(&lock_);
+    }
+
+    void lock() {
+        pthread_rwlock_wrlock(&lock_);
+    }
+
+    bool tryLock() {
+        return pthread_rwlock_trywrlock(&lock_) == 0;
+    }
+
+    void unlock() {
+        pthread_rwlock_unlock(&lock_);
+    }
+
+    void lockShared() {
+        pthread_rwlock_rdlock(&lock_);
+    }
+
+    bool tryLockShared() {
+        return pthread_rwlock_tryrdlock(&lock_) == 0;
+    }
+
+    void unlockShared() {
+        pthread_rwlock_unlock(&lock_);
+    }
+
+    void reset() {
+        memset(&lock_, 0, sizeof(lock_));
+        lock_ = PTHREAD_RWLOCK_INITIALIZER;
+    }
+};
+
 #endif // _OBJC_PTHREAD_H
@@ -37,8 +37,9 @@ enum class tls_key {
     autorelease_pool           = 3,
 #if SUPPORT_RETURN_AUTORELEASE
     return_autorelease_object  = 4,
-    return_autorelease_address = 5
+    return_autorelease_address = 5,
 #endif
+    weak_hazard                = 6
 };
 
 #if OBJC_THREADING_PACKAGE == OBJC_THREADING_NONE
@@ -62,4 +63,7 @@ using objc_recursive_lock_t =
     locker_mixin<lockdebug::lock_mixin<objc_recursive_lock_base_t>>;
 using objc_nodebug_lock_t = locker_mixin<objc_lock_base_t>;
 
+// Readers-writer locks are not checked by lockdebug.
+using objc_rwlock_t = objc_rwlock_base_t;
+
 #endif // _OBJC_THREADING_H
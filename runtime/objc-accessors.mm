@@ -25,6 +25,7 @@
 #include <stddef.h>
 
 #include "objc-private.h"
+#include "objc-weak.h"
 #include "runtime.h"
 
 // stub interface declarations to make compiler happy.
@@ -38,11 +39,65 @@
 @end
 
 StripedMap<spinlock_t> PropertyLocks;
-StripedMap<spinlock_t> StructLocks;
+StripedMap<StructLock> StructLocks;
 StripedMap<spinlock_t> CppObjectLocks;
 
 #define MUTABLE_COPY 2
 
+#if ISA_HAS_INLINE_RC
+/*
+  Lock-free fast path for atomic objc_getProperty().
+
+  The value is protected by the calling thread's weak hazard record
+  instead of the PropertyLocks stripe, so concurrent getters of the same
+  property don't write to a shared lock. Once the slot has been re-read
+  and still holds the value after the hazard is published, the value
+  cannot be freed: atomic setters call weak_wait_for_readers() on the old
+  value before releasing it.
+
+  Returns true and sets *result to the retained value if the load was
+  completed. Returns false if the locked path must be used.
+*/
+static ALWAYS_INLINE bool
+getPropertyOptimistic(id *slot, id *result)
+{
+    weak_hazard_t *hazard = weak_hazard_for_thread();
+    if (slowpath(!hazard)) return false;
+
+    auto *var = explicit_atomic<id>::from_pointer(slot);
+    id value = var->load(std::memory_order_relaxed);
+    if (_objc_isTaggedPointerOrNil(value)) {
+        *result = value;
+        return true;
+    }
+
+    weak_hazard_enter();
+    while (true) {
+        hazard->referent.store(value, std::memory_order_seq_cst);
+        id check = var->load(std::memory_order_seq_cst);
+        if (fastpath(check == value)) break;
+        value = check;
+        if (_objc_isTaggedPointerOrNil(value)) {
+            weak_hazard_leave(hazard);
+            *result = value;
+            return true;
+        }
+    }
+
+    bool done = false;
+    bool needsSideTable;
+    if (fastpath(value->hasNonpointerIsa()  &&  !value->ISA()->hasCustomRR())) {
+        if (value->rootTryRetainInline(&needsSideTable)) {
+            *result = value;
+            done = true;
+        }
+    }
+
+    weak_hazard_leave(hazard);
+    return done;
+}
+#endif
+
 id objc_getProperty(id self, SEL _cmd, ptrdiff_t offset, BOOL atomic) {
     if (offset == 0) {
         return object_getClass(self);
@@ -51,7 +106,16 @@ id objc_getProperty(id self, SEL _cmd, ptrdiff_t offset, BOOL atomic) {
     // Retain release world
     id *slot = (id*) ((char*)self + offset);
     if (!atomic) return *slot;
-        
+
+#if ISA_HAS_INLINE_RC
+    id result;
+    if (fastpath(!DisableOptimisticPropertyReads)  &&
+        getPropertyOptimistic(slot, &result))
+    {
+        return objc_autoreleaseReturnValue(result);
+    }
+#endif
+
     // Atomic retain release world
     spinlock_t& slotlock = PropertyLocks[slot];
     slotlock.lock();
@@ -91,8 +155,17 @@ static inline void reallySetProperty(id self, SEL _cmd, id newValue, ptrdiff_t o
         spinlock_t& slotlock = PropertyLocks[slot];
         slotlock.lock();
         oldValue = *slot;
-        *slot = newValue;        
+        explicit_atomic<id>::from_pointer(slot)->store(newValue, std::memory_order_relaxed);
         slotlock.unlock();
+
+#if ISA_HAS_INLINE_RC
+        // A lock-free getter may be retaining the old value.
+        if (!DisableOptimisticPropertyReads  &&
+            !_objc_isTaggedPointerOrNil(oldValue))
+        {
+            weak_wait_for_readers(oldValue);
+        }
+#endif
     }
 
     objc_release(oldValue);
@@ -127,32 +200,199 @@ void objc_setProperty_nonatomic_copy(id self, SEL _cmd, id newValue, ptrdiff_t o
 }
 
 
+// Atomic structs up to this size are copied through a buffer on the
+// stack, reading the source without a lock. Larger ones lock both sides.
+#define SEQLOCK_STRUCT_MAX 128
+
+// Readers spin this many times on a busy stripe before waiting for its lock.
+#define SEQLOCK_READ_SPINS 64
+
+// Returns true if size is copied with one atomic load or store
+// when the address is aligned to size.
+static ALWAYS_INLINE bool
+structHasAtomicSize(ptrdiff_t size)
+{
+    switch (size) {
+    case 1: case 2: case 4: case 8:
+        return true;
+#if __SIZEOF_INT128__  &&  (__arm64__  ||  __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+    case 16:
+        // LDXP/STXP on arm64, cmpxchg16b on x86_64. See load16().
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+#if __SIZEOF_INT128__  &&  (__arm64__  ||  __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+// Loads 16 aligned bytes atomically. On x86_64 __atomic_load_n is a
+// cmpxchg16b, which takes the line exclusive even to read it. Processors
+// with AVX make aligned 16-byte vector loads single-copy atomic, so use
+// one of those when the processor has it.
+static ALWAYS_INLINE __uint128_t
+load16(const void *src)
+{
+#if __x86_64__
+    static const bool hasAtomicVectorLoads = [] {
+        __builtin_cpu_init();
+        return (bool)__builtin_cpu_supports("avx");
+    }();
+    if (fastpath(hasAtomicVectorLoads)) {
+        typedef long long vector16 __attribute__((vector_size(16)));
+        vector16 v;
+        // volatile and the memory clobber keep it ordered like an
+        // acquire load; x86 doesn't reorder loads with later accesses.
+        asm volatile("vmovdqa %1, %0"
+                     : "=x"(v) : "m"(*(const vector16 *)src) : "memory");
+        __uint128_t result;
+        memcpy(&result, &v, sizeof(result));
+        return result;
+    }
+#endif
+    return __atomic_load_n((const __uint128_t *)src, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static ALWAYS_INLINE bool
+structIsAtomic(const void *p, ptrdiff_t size)
+{
+    return structHasAtomicSize(size)  &&  ((uintptr_t)p & (size - 1)) == 0;
+}
+
+// Returns true if p is in a caller's frame on the current thread's stack,
+// where no other thread can be accessing it: a getter's result buffer or
+// a setter's argument. Returns false if that can't be told cheaply.
+static ALWAYS_INLINE bool
+structIsOnCurrentStack(const void *p)
+{
+#if OBJC_THREADING_PACKAGE == OBJC_THREADING_DARWIN
+    pthread_t self = pthread_self();
+    uintptr_t top = (uintptr_t)pthread_get_stackaddr_np(self);
+    uintptr_t bottom = (uintptr_t)__builtin_frame_address(0);
+    return (uintptr_t)p >= bottom  &&  (uintptr_t)p < top;
+#else
+    (void)p;
+    return false;
+#endif
+}
+
+// Copies a struct into a buffer. src is read with one atomic load
+// if its size and alignment allow it, or with the stripe's seqlock.
+static void
+loadStruct(void *buffer, const void *src, ptrdiff_t size)
+{
+    if (structIsAtomic(src, size)) {
+        switch (size) {
+        case 1: *(uint8_t *)buffer = __atomic_load_n((const uint8_t *)src, __ATOMIC_ACQUIRE); return;
+        case 2: *(uint16_t *)buffer = __atomic_load_n((const uint16_t *)src, __ATOMIC_ACQUIRE); return;
+        case 4: *(uint32_t *)buffer = __atomic_load_n((const uint32_t *)src, __ATOMIC_ACQUIRE); return;
+        case 8: *(uint64_t *)buffer = __atomic_load_n((const uint64_t *)src, __ATOMIC_ACQUIRE); return;
+#if __SIZEOF_INT128__  &&  (__arm64__  ||  __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+        case 16: *(__uint128_t *)buffer = load16(src); return;
+#endif
+        }
+    }
+
+    StructLock &srcLock = StructLocks[src];
+    for (unsigned spins = 0; spins < SEQLOCK_READ_SPINS; spins++) {
+        uintptr_t seq = srcLock.sequence.load(std::memory_order_acquire);
+        if (seq & 1) continue;
+        memcpy(buffer, src, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (srcLock.sequence.load(std::memory_order_relaxed) == seq) return;
+    }
+
+    // A writer keeps getting in the way, or was preempted while
+    // holding the stripe. Wait for it on the lock instead of spinning.
+    srcLock.lock();
+    memcpy(buffer, src, size);
+    srcLock.unlock();
+}
+
+// Copies a buffer into a struct. dest is written with one atomic store
+// if its size and alignment allow it, or under the stripe's seqlock.
+static void
+storeStruct(void *dest, const void *buffer, ptrdiff_t size)
+{
+    if (structIsAtomic(dest, size)) {
+        switch (size) {
+        case 1: __atomic_store_n((uint8_t *)dest, *(const uint8_t *)buffer, __ATOMIC_RELEASE); return;
+        case 2: __atomic_store_n((uint16_t *)dest, *(const uint16_t *)buffer, __ATOMIC_RELEASE); return;
+        case 4: __atomic_store_n((uint32_t *)dest, *(const uint32_t *)buffer, __ATOMIC_RELEASE); return;
+        case 8: __atomic_store_n((uint64_t *)dest, *(const uint64_t *)buffer, __ATOMIC_RELEASE); return;
+#if __SIZEOF_INT128__  &&  (__arm64__  ||  __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+        case 16: __atomic_store_n((__uint128_t *)dest, *(const __uint128_t *)buffer, __ATOMIC_RELEASE); return;
+#endif
+        }
+    }
+
+    StructLock &dstLock = StructLocks[dest];
+    dstLock.lock();
+    uintptr_t seq = dstLock.sequence.load(std::memory_order_relaxed);
+    dstLock.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(dest, buffer, size);
+    dstLock.sequence.store(seq + 2, std::memory_order_release);
+    dstLock.unlock();
+}
+
 // This entry point was designed wrong.  When used as a getter, src needs to be locked so that
 // if simultaneously used for a setter then there would be contention on src.
 // So we need two locks - one of which will be contended.
+// Structs up to SEQLOCK_STRUCT_MAX bytes avoid that: the source is read
+// with an atomic load or a seqlock, and only a non-atomic destination is
+// locked. Every access to a given struct picks the same method because
+// the choice depends only on the struct's own size and address.
+// A side on the calling thread's stack is private to this thread, so it
+// is neither locked nor has its stripe's sequence bumped.
 void objc_copyStruct(void *dest, const void *src, ptrdiff_t size, BOOL atomic, BOOL hasStrong __unused) {
+    if (atomic  &&  size <= SEQLOCK_STRUCT_MAX) {
+        alignas(16) uint8_t buffer[SEQLOCK_STRUCT_MAX];
+        loadStruct(buffer, src, size);
+        if (structIsOnCurrentStack(dest)) {
+            // Getter: only the property is shared.
+            memcpy(dest, buffer, size);
+        } else {
+            storeStruct(dest, buffer, size);
+        }
+        return;
+    }
+
     spinlock_t *srcLock = nil;
     spinlock_t *dstLock = nil;
     if (atomic) {
-        srcLock = &StructLocks[src];
-        dstLock = &StructLocks[dest];
-        spinlock_t::lockTwo(srcLock, dstLock);
+        if (!structIsOnCurrentStack(src)) srcLock = &StructLocks[src].slock;
+        if (!structIsOnCurrentStack(dest)) dstLock = &StructLocks[dest].slock;
+        if (srcLock  &&  dstLock) spinlock_t::lockTwo(srcLock, dstLock);
+        else if (srcLock) srcLock->lock();
+        else if (dstLock) dstLock->lock();
     }
 
     memmove(dest, src, size);
 
-    if (atomic) {
-        spinlock_t::unlockTwo(srcLock, dstLock);
-    }
+    if (srcLock  &&  dstLock) spinlock_t::unlockTwo(srcLock, dstLock);
+    else if (srcLock) srcLock->unlock();
+    else if (dstLock) dstLock->unlock();
 }
 
+// copyHelper runs arbitrary C++ copy code, which can't be given a torn
+// source to retry like a seqlock reader, so C++ objects are always copied
+// under the locks. As in objc_copyStruct, a side on the calling thread's
+// stack isn't locked.
 void objc_copyCppObjectAtomic(void *dest, const void *src, void (*copyHelper) (void *dest, const void *source)) {
-    spinlock_t *srcLock = &CppObjectLocks[src];
-    spinlock_t *dstLock = &CppObjectLocks[dest];
-    spinlock_t::lockTwo(srcLock, dstLock);
+    spinlock_t *srcLock = nil;
+    spinlock_t *dstLock = nil;
+    if (!structIsOnCurrentStack(src)) srcLock = &CppObjectLocks[src];
+    if (!structIsOnCurrentStack(dest)) dstLock = &CppObjectLocks[dest];
+    if (srcLock  &&  dstLock) spinlock_t::lockTwo(srcLock, dstLock);
+    else if (srcLock) srcLock->lock();
+    else if (dstLock) dstLock->lock();
 
     // let C++ code perform the actual copy.
     copyHelper(dest, src);
     
-    spinlock_t::unlockTwo(srcLock, dstLock);
+    if (srcLock  &&  dstLock) spinlock_t::unlockTwo(srcLock, dstLock);
+    else if (srcLock) srcLock->unlock();
+    else if (dstLock) dstLock->unlock();
 }
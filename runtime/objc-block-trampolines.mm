@@ -227,18 +227,29 @@ typedef enum {
 // default alignment when running with small pages, but it also means 
 // the trampoline code MUST NOT look for its data by masking with PAGE_MAX_MASK.
 
+// Each page group's free list is changed without locking. The list head
+// holds the index of the next available slot in its low bits and a count
+// of changes in the rest, so a thread that read a stale head can't
+// install it. The head is 64 bits on every target so that the count
+// can't wrap around while a thread holds a stale head.
+#define FREE_LIST_INDEX_BITS 16
+#define FREE_LIST_INDEX_MASK ((uint64_t(1) << FREE_LIST_INDEX_BITS) - 1)
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "trampoline free lists need a lock-free 64-bit atomic");
+
 struct TrampolineBlockPageGroup
 {
-    TrampolineBlockPageGroup * ptrauth_trampoline_block_page_group nextPageGroup; // linked list of all pages
-    TrampolineBlockPageGroup * ptrauth_trampoline_block_page_group nextAvailablePage; // linked list of pages with available slots
+    // Linked list of all page groups, signed. Other threads walk it
+    // without locking. See HeadPageGroup.
+    std::atomic<uintptr_t> nextPageGroup;
 
-    uintptr_t nextAvailable; // index of next available slot, endIndex() if no more available
+    std::atomic<uint64_t> nextAvailable; // free list head; index is endIndex() if no more available
 
     const void * TrampolinePtrauth const text;  // text VM region; stored only for the benefit of the leaks tool
 
     TrampolineBlockPageGroup()
-        : nextPageGroup(nil)
-        , nextAvailablePage(nil)
+        : nextPageGroup(0)
         , nextAvailable(startIndex())
         , text((const void *)((uintptr_t)this + Trampolines.dataSize()))
     { }
@@ -290,6 +301,69 @@ struct TrampolineBlockPageGroup
         return (Payload *)((char *)this + index*slotSize());
     }
 
+    explicit_atomic<uintptr_t> *freeLink(uintptr_t index) {
+        return explicit_atomic<uintptr_t>::from_pointer(&payload(index)->nextAvailable);
+    }
+
+    static uint64_t freeListHead(uint64_t oldHead, uintptr_t index) {
+        return ((oldHead + (uint64_t(1) << FREE_LIST_INDEX_BITS)) &
+                ~FREE_LIST_INDEX_MASK) | index;
+    }
+
+    static uintptr_t freeListIndex(uint64_t head) {
+        return (uintptr_t)(head & FREE_LIST_INDEX_MASK);
+    }
+
+    bool hasAvailable() {
+        uint64_t head = nextAvailable.load(std::memory_order_relaxed);
+        return freeListIndex(head) != endIndex();
+    }
+
+    // Takes up to count slots off the free list.
+    // Returns how many were taken, with their indexes in indexes[].
+    unsigned allocateSlots(uintptr_t *indexes, unsigned count) {
+        uint64_t head = nextAvailable.load(std::memory_order_acquire);
+      retry:
+        unsigned n = 0;
+        uintptr_t index = freeListIndex(head);
+        while (n < count  &&  index != endIndex()) {
+            indexes[n++] = index;
+            // Another thread may take this slot and store its block
+            // here first. The exchange below fails if it did.
+            uintptr_t next = freeLink(index)->load(std::memory_order_relaxed);
+            if (next == 0) {
+                // First time through (unused slots are zero).
+                // Fill sequentially.
+                next = index + 1;
+            } else if (!validIndex(next)  &&  next != endIndex()) {
+                head = nextAvailable.load(std::memory_order_acquire);
+                goto retry;
+            }
+            index = next;
+        }
+        if (n == 0) return 0;
+        if (!nextAvailable.compare_exchange_weak(head, freeListHead(head, index),
+                                                 std::memory_order_acquire,
+                                                 std::memory_order_acquire))
+        {
+            goto retry;
+        }
+        return n;
+    }
+
+    // Returns a slot to the free list.
+    // Returns true if the page group was full.
+    bool freeSlot(uintptr_t index) {
+        uint64_t head = nextAvailable.load(std::memory_order_relaxed);
+        do {
+            freeLink(index)->store(freeListIndex(head),
+                                   std::memory_order_relaxed);
+        } while (!nextAvailable.compare_exchange_weak(head, freeListHead(head, index),
+                                                      std::memory_order_release,
+                                                      std::memory_order_relaxed));
+        return freeListIndex(head) == endIndex();
+    }
+
     uintptr_t trampolinesForMode(int aMode) {
         // Skip over the data area, one page of Mach-O headers,
         // and one text page for each mode before this one.
@@ -327,11 +401,100 @@ struct TrampolineBlockPageGroup
     static void check() {
         ASSERT(TrampolineBlockPageGroup::headerSize() >= sizeof(TrampolineBlockPageGroup));
         ASSERT(TrampolineBlockPageGroup::headerSize() % TrampolineBlockPageGroup::slotSize() == 0);
+        ASSERT(TrampolineBlockPageGroup::endIndex() <= FREE_LIST_INDEX_MASK);
     }
 
 };
 
-static TrampolineBlockPageGroup * ptrauth_trampoline_block_page_group HeadPageGroup;
+// The list of all page groups. Links are only added, with runtimeLock
+// held, and are stored with release and loaded with acquire so that a
+// thread walking the list without locking sees each page group's
+// initialized header.
+static std::atomic<uintptr_t> HeadPageGroup{0};  // signed
+
+// A page group that had available slots recently. Allocation tries it
+// before searching the list of page groups.
+static std::atomic<uintptr_t> AvailablePageGroup{0};
+
+// Every stored page group pointer is signed.
+#define PAGE_GROUP_SIGNING_DISCRIMINATOR \
+    ptrauth_string_discriminator("TrampolineBlockPageGroup")
+
+static uintptr_t signPageGroup(TrampolineBlockPageGroup *pageGroup)
+{
+    if (!pageGroup) return 0;
+    return (uintptr_t)ptrauth_sign_unauthenticated(pageGroup, ptrauth_key_process_dependent_data, PAGE_GROUP_SIGNING_DISCRIMINATOR);
+}
+
+static TrampolineBlockPageGroup *authPageGroup(uintptr_t signedPageGroup)
+{
+    if (!signedPageGroup) return nil;
+    return (TrampolineBlockPageGroup *)ptrauth_auth_data((void *)signedPageGroup, ptrauth_key_process_dependent_data, PAGE_GROUP_SIGNING_DISCRIMINATOR);
+}
+
+// Maps every text page of every page group, by address, to its page
+// group. Keys are addresses divided by PAGE_MIN_SIZE, so the map doesn't
+// depend on the process's page size. Readers search it without locking.
+// It is only written with runtimeLock held. Entries are never removed
+// because page groups are never deallocated. A full map is replaced by
+// one twice its size, and the old map is leaked because readers may
+// still be searching it.
+struct TrampolinePageMap {
+    struct Entry {
+        std::atomic<uintptr_t> page;
+        std::atomic<uintptr_t> pageGroup;  // signed
+    };
+
+    uintptr_t mask;
+    uintptr_t occupied;
+    Entry entries[0];
+
+    Entry *find(uintptr_t page) {
+        uintptr_t index = ptr_hash(page) & mask;
+        while (uintptr_t key = entries[index].page.load(std::memory_order_acquire)) {
+            if (key == page) break;
+            index = (index + 1) & mask;
+        }
+        return &entries[index];
+    }
+};
+
+#define TRAMPOLINE_PAGE_MAP_INITIAL_CAPACITY 64
+
+static std::atomic<TrampolinePageMap *> PageMap{nil};
+
+static void
+addToPageMap(uintptr_t page, TrampolineBlockPageGroup *pageGroup)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    TrampolinePageMap *map = PageMap.load(std::memory_order_relaxed);
+    if (!map  ||  (map->occupied + 1) * 4 > (map->mask + 1) * 3) {
+        uintptr_t capacity = map ? (map->mask + 1) * 2
+                                 : TRAMPOLINE_PAGE_MAP_INITIAL_CAPACITY;
+        auto newMap = (TrampolinePageMap *)
+            calloc(1, sizeof(TrampolinePageMap) +
+                   capacity * sizeof(TrampolinePageMap::Entry));
+        newMap->mask = capacity - 1;
+        for (uintptr_t i = 0; map  &&  i <= map->mask; i++) {
+            uintptr_t key = map->entries[i].page.load(std::memory_order_relaxed);
+            if (!key) continue;
+            auto entry = newMap->find(key);
+            entry->pageGroup.store(map->entries[i].pageGroup.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            entry->page.store(key, std::memory_order_relaxed);
+            newMap->occupied++;
+        }
+        PageMap.store(newMap, std::memory_order_release);
+        map = newMap;
+    }
+
+    // Publish the page group before the page
+    // so readers that find the page also find its group.
+    auto entry = map->find(page);
+    entry->pageGroup.store(signPageGroup(pageGroup), std::memory_order_relaxed);
+    entry->page.store(page, std::memory_order_release);
+    map->occupied++;
+}
 
 #pragma mark Utility Functions
 
@@ -358,8 +521,6 @@ static TrampolineBlockPageGroup *_allocateTrampolinesAndData()
     // We assume that our code begins on the second TEXT page, but are robust
     // against other additions to the end of the TEXT segment.
 
-    ASSERT(HeadPageGroup == nil  ||  HeadPageGroup->nextAvailablePage == nil);
-
     auto textSource = Trampolines.textSegment();
     auto textSourceSize = Trampolines.textSegmentSize();
     auto dataSize = Trampolines.dataSize();
@@ -387,61 +548,102 @@ static TrampolineBlockPageGroup *_allocateTrampolinesAndData()
     }
 
     auto *pageGroup = new ((void*)dataAddress) TrampolineBlockPageGroup;
-    
-    if (HeadPageGroup) {
-        TrampolineBlockPageGroup *lastPageGroup = HeadPageGroup;
-        while(lastPageGroup->nextPageGroup) {
-            lastPageGroup = lastPageGroup->nextPageGroup;
+
+    for (int aMode = 0; aMode < ArgumentModeCount; aMode++) {
+        uintptr_t text = pageGroup->trampolinesForMode(aMode);
+        for (uintptr_t offset = 0;
+             offset < TRAMPOLINE_PAGE_SIZE;
+             offset += PAGE_MIN_SIZE)
+        {
+            addToPageMap((text + offset) / PAGE_MIN_SIZE, pageGroup);
         }
-        lastPageGroup->nextPageGroup = pageGroup;
-        HeadPageGroup->nextAvailablePage = pageGroup;
-    } else {
-        HeadPageGroup = pageGroup;
     }
-    
+
+    // Other threads walk the list without locking.
+    std::atomic<uintptr_t> *link = &HeadPageGroup;
+    while (TrampolineBlockPageGroup *lastPageGroup =
+           authPageGroup(link->load(std::memory_order_relaxed)))
+    {
+        link = &lastPageGroup->nextPageGroup;
+    }
+    link->store(signPageGroup(pageGroup), std::memory_order_release);
+
     return pageGroup;
 }
 
+static TrampolineBlockPageGroup *
+firstPageGroupWithNextAvailable()
+{
+    for (TrampolineBlockPageGroup *pageGroup =
+             authPageGroup(HeadPageGroup.load(std::memory_order_acquire));
+         pageGroup;
+         pageGroup = authPageGroup(pageGroup->nextPageGroup.load(std::memory_order_acquire)))
+    {
+        if (pageGroup->hasAvailable()) {
+            AvailablePageGroup.store(signPageGroup(pageGroup),
+                                     std::memory_order_release);
+            return pageGroup;
+        }
+    }
+    return nil;
+}
+
+/***********************************************************************
+* getOrAllocatePageGroupWithNextAvailable
+* Returns a page group that had an available slot.
+* Locking: acquires runtimeLock if a new page group is needed.
+*   The caller must not hold it.
+**********************************************************************/
 static TrampolineBlockPageGroup *
 getOrAllocatePageGroupWithNextAvailable() 
 {
-    lockdebug::assert_locked(&runtimeLock);
+    TrampolineBlockPageGroup *pageGroup =
+        authPageGroup(AvailablePageGroup.load(MEMORY_ORDER_CONSUME));
+    if (pageGroup  &&  pageGroup->hasAvailable())
+        return pageGroup;
 
-    if (!HeadPageGroup)
-        return _allocateTrampolinesAndData();
-    
-    // make sure head page is filled first
-    if (HeadPageGroup->nextAvailable != HeadPageGroup->endIndex())
-        return HeadPageGroup;
-    
-    if (HeadPageGroup->nextAvailablePage) // check if there is a page w/a hole
-        return HeadPageGroup->nextAvailablePage;
-    
-    return _allocateTrampolinesAndData(); // tack on a new one
+    // Look for a page with a hole.
+    pageGroup = firstPageGroupWithNextAvailable();
+    if (pageGroup) return pageGroup;
+
+    // Tack on a new one, unless another thread did while we waited.
+    mutex_locker_t lock(runtimeLock);
+    pageGroup = firstPageGroupWithNextAvailable();
+    if (pageGroup) return pageGroup;
+
+    pageGroup = _allocateTrampolinesAndData();
+    AvailablePageGroup.store(signPageGroup(pageGroup),
+                             std::memory_order_release);
+    return pageGroup;
 }
 
+/***********************************************************************
+* pageAndIndexContainingIMP
+* Finds the page group and slot of a trampoline through PageMap.
+* Locking: none
+**********************************************************************/
 static TrampolineBlockPageGroup *
 pageAndIndexContainingIMP(IMP anImp, uintptr_t *outIndex) 
 {
-    lockdebug::assert_locked(&runtimeLock);
-
     // Authenticate as a function pointer, returning an un-signed address.
     uintptr_t trampAddress =
             (uintptr_t)ptrauth_auth_data((const char *)anImp,
                                          ptrauth_key_function_pointer, 0);
 
-    for (TrampolineBlockPageGroup *pageGroup = HeadPageGroup; 
-         pageGroup;
-         pageGroup = pageGroup->nextPageGroup)
-    {
-        uintptr_t index = pageGroup->indexForTrampoline(trampAddress);
-        if (index) {
-            if (outIndex) *outIndex = index;
-            return pageGroup;
-        }
-    }
-    
-    return nil;
+    TrampolinePageMap *map = PageMap.load(std::memory_order_acquire);
+    if (!map) return nil;
+
+    uintptr_t page = trampAddress / PAGE_MIN_SIZE;
+    auto entry = map->find(page);
+    if (entry->page.load(std::memory_order_acquire) != page) return nil;
+
+    TrampolineBlockPageGroup *pageGroup =
+        authPageGroup(entry->pageGroup.load(std::memory_order_relaxed));
+    uintptr_t index = pageGroup->indexForTrampoline(trampAddress);
+    if (!index) return nil;
+
+    if (outIndex) *outIndex = index;
+    return pageGroup;
 }
 
 
@@ -486,41 +688,44 @@ _imp_implementationWithBlock_init(void)
 }
 
 
-// `block` must already have been copied 
-IMP 
-_imp_implementationWithBlockNoCopy(id block)
-{
-    lockdebug::assert_locked(&runtimeLock);
+// Slots taken from a page group's free list at a time.
+#define TRAMPOLINE_BATCH 64
 
-    TrampolineBlockPageGroup *pageGroup = 
-        getOrAllocatePageGroupWithNextAvailable();
+// `blocks` must already have been copied
+// Locking: acquires runtimeLock if a new page group is needed.
+//   The caller must not hold it.
+static void
+_imp_implementationsWithBlocksNoCopy(const id *blocks, IMP *imps,
+                                     unsigned count)
+{
+    uintptr_t indexes[TRAMPOLINE_BATCH];
 
-    uintptr_t index = pageGroup->nextAvailable;
-    ASSERT(index >= pageGroup->startIndex()  &&  index < pageGroup->endIndex());
-    TrampolineBlockPageGroup::Payload *payload = pageGroup->payload(index);
-    
-    uintptr_t nextAvailableIndex = payload->nextAvailable;
-    if (nextAvailableIndex == 0) {
-        // First time through (unused slots are zero). Fill sequentially.
-        // If the page is now full this will now be endIndex(), handled below.
-        nextAvailableIndex = index + 1;
-    }
-    pageGroup->nextAvailable = nextAvailableIndex;
-    if (nextAvailableIndex == pageGroup->endIndex()) {
-        // PageGroup is now full (free list or wilderness exhausted)
-        // Remove from available page linked list
-        TrampolineBlockPageGroup *iterator = HeadPageGroup;
-        while(iterator && (iterator->nextAvailablePage != pageGroup)) {
-            iterator = iterator->nextAvailablePage;
-        }
-        if (iterator) {
-            iterator->nextAvailablePage = pageGroup->nextAvailablePage;
-            pageGroup->nextAvailablePage = nil;
+    while (count > 0) {
+        TrampolineBlockPageGroup *pageGroup =
+            getOrAllocatePageGroupWithNextAvailable();
+        unsigned n = pageGroup->allocateSlots
+            (indexes, std::min(count, (unsigned)TRAMPOLINE_BATCH));
+
+        // n is zero if other threads took the rest of this page group.
+        for (unsigned i = 0; i < n; i++) {
+            pageGroup->payload(indexes[i])->block = blocks[i];
+            imps[i] = pageGroup->trampoline(argumentModeForBlock(blocks[i]),
+                                            indexes[i]);
         }
+        blocks += n;
+        imps += n;
+        count -= n;
     }
-    
-    payload->block = block;
-    return pageGroup->trampoline(argumentModeForBlock(block), index);
+}
+
+
+// `block` must already have been copied 
+IMP 
+_imp_implementationWithBlockNoCopy(id block)
+{
+    IMP imp;
+    _imp_implementationsWithBlocksNoCopy(&block, &imp, 1);
+    return imp;
 }
 
 
@@ -534,21 +739,37 @@ IMP imp_implementationWithBlock(id block)
     // Trampolines must be initialized outside runtimeLock
     // because it calls dlopen().
     Trampolines.Initialize();
-    
-    mutex_locker_t lock(runtimeLock);
 
     return _imp_implementationWithBlockNoCopy(block);
 }
 
 
+void imp_implementationWithBlocks(id const *blocks, IMP *imps, unsigned count)
+{
+    if (count == 0) return;
+
+    Trampolines.Initialize();
+
+    id copies[TRAMPOLINE_BATCH];
+    while (count > 0) {
+        unsigned n = std::min(count, (unsigned)TRAMPOLINE_BATCH);
+        for (unsigned i = 0; i < n; i++) {
+            copies[i] = Block_copy(blocks[i]);
+        }
+        _imp_implementationsWithBlocksNoCopy(copies, imps, n);
+        blocks += n;
+        imps += n;
+        count -= n;
+    }
+}
+
+
 id imp_getBlock(IMP anImp) {
     uintptr_t index;
     TrampolineBlockPageGroup *pageGroup;
     
     if (!anImp) return nil;
     
-    mutex_locker_t lock(runtimeLock);
-    
     pageGroup = pageAndIndexContainingIMP(anImp, &index);
     
     if (!pageGroup) {
@@ -569,46 +790,36 @@ BOOL imp_removeBlock(IMP anImp) {
     
     if (!anImp) return NO;
 
-    id block;
-    
-    {
-        mutex_locker_t lock(runtimeLock);
-    
-        uintptr_t index;
-        TrampolineBlockPageGroup *pageGroup =
-            pageAndIndexContainingIMP(anImp, &index);
-        
-        if (!pageGroup) {
+    uintptr_t index;
+    TrampolineBlockPageGroup *pageGroup =
+        pageAndIndexContainingIMP(anImp, &index);
+
+    if (!pageGroup) {
+        return NO;
+    }
+
+    // Claim the slot by replacing its block with a free list index, so
+    // that of two threads removing the same IMP only one frees the slot
+    // and releases the block.
+    auto *link = pageGroup->freeLink(index);
+    uintptr_t block = link->load(std::memory_order_relaxed);
+    do {
+        if (block <= TrampolineBlockPageGroup::endIndex()) {
+            // unallocated
             return NO;
         }
-        
-        TrampolineBlockPageGroup::Payload *payload = pageGroup->payload(index);
-        block = payload->block;
-        // block is released below, outside the lock
-        
-        payload->nextAvailable = pageGroup->nextAvailable;
-        pageGroup->nextAvailable = index;
-        
-        // make sure this page is on available linked list
-        TrampolineBlockPageGroup *pageGroupIterator = HeadPageGroup;
-        
-        // see if page is the next available page for any existing pages
-        while (pageGroupIterator->nextAvailablePage && 
-               pageGroupIterator->nextAvailablePage != pageGroup)
-        {
-            pageGroupIterator = pageGroupIterator->nextAvailablePage;
-        }
-        
-        if (! pageGroupIterator->nextAvailablePage) {
-            // if iteration stopped because nextAvail was nil
-            // add to end of list.
-            pageGroupIterator->nextAvailablePage = pageGroup;
-            pageGroup->nextAvailablePage = nil;
-        }
+    } while (!link->compare_exchange_weak(block,
+                                          TrampolineBlockPageGroup::endIndex(),
+                                          std::memory_order_relaxed,
+                                          std::memory_order_relaxed));
+
+    // A page group that was full has a hole now.
+    if (pageGroup->freeSlot(index)) {
+        AvailablePageGroup.store(signPageGroup(pageGroup),
+                                 std::memory_order_release);
     }
 
-    // do this AFTER dropping the lock
-    Block_release(block);
+    Block_release((id)block);
     return YES;
 }
 
@@ -437,25 +437,21 @@ Ivar object_getInstanceVariable(id obj, const char *name, void **value)
 * Call C++ destructors on obj, starting with cls's 
 *   dtor method (if any) followed by superclasses' dtors (if any), 
 *   stopping at cls's dtor (if any).
-* Uses methodListLock and cacheUpdateLock. The caller must hold neither.
+* Uses runtimeLock the first time for each class. The caller must not
+*   hold it.
 **********************************************************************/
 static void object_cxxDestructFromClass(id obj, Class cls)
 {
-    void (*dtor)(id);
-
-    // Call cls's dtor first, then superclasses's dtors.
-
-    for ( ; cls; cls = cls->getSuperclass()) {
-        if (!cls->hasCxxDtor()) return; 
-        dtor = (void(*)(id))
-            lookupMethodInClassAndLoadCache(cls, SEL_cxx_destruct);
-        if (dtor != (void(*)(id))_objc_msgForward_impcache) {
-            if (PrintCxxCtors) {
-                _objc_inform("CXX: calling C++ destructors for class %s", 
-                             cls->nameForLogging());
-            }
-            (*dtor)(obj);
+    if (!cls  ||  !cls->hasCxxDtor()) return;
+
+    const cxx_chain_t *chain = getCxxChain(cls);
+    const cxx_chain_t::entry_t *dtors = chain->destructors();
+    for (uint32_t i = 0; i < chain->destructCount; i++) {
+        if (PrintCxxCtors) {
+            _objc_inform("CXX: calling C++ destructors for class %s", 
+                         dtors[i].cls->nameForLogging());
         }
+        ((void(*)(id))dtors[i].imp)(obj);
     }
 }
 
@@ -474,14 +470,15 @@ void object_cxxDestruct(id obj)
 
 /***********************************************************************
 * object_cxxConstructFromClass.
-* Recursively call C++ constructors on obj, starting with base class's 
+* Call C++ constructors on obj, starting with base class's 
 *   ctor method (if any) followed by subclasses' ctors (if any), stopping 
 *   at cls's ctor (if any).
 * Does not check cls->hasCxxCtor(). The caller should preflight that.
 * Returns self if construction succeeded.
 * Returns nil if some constructor threw an exception. The exception is 
 *   caught and discarded. Any partial construction is destructed.
-* Uses methodListLock and cacheUpdateLock. The caller must hold neither.
+* Uses runtimeLock the first time for each class. The caller must not
+*   hold it.
 *
 * .cxx_construct returns id. This really means:
 * return self: construction succeeded
@@ -492,38 +489,25 @@ object_cxxConstructFromClass(id obj, Class cls, int flags)
 {
     ASSERT(cls->hasCxxCtor());  // required for performance, not correctness
 
-    id (*ctor)(id);
-    Class supercls;
-
-    supercls = cls->getSuperclass();
-
-    // Call superclasses' ctors first, if any.
-    if (supercls  &&  supercls->hasCxxCtor()) {
-        bool ok = object_cxxConstructFromClass(obj, supercls, flags);
-        if (slowpath(!ok)) return nil;  // some superclass's ctor failed - give up
-    }
-
-    // Find this class's ctor, if any.
-    ctor = (id(*)(id))lookupMethodInClassAndLoadCache(cls, SEL_cxx_construct);
-    if (ctor == (id(*)(id))_objc_msgForward_impcache) return obj;  // no ctor - ok
-    
-    // Call this class's ctor.
-    if (PrintCxxCtors) {
-        _objc_inform("CXX: calling C++ constructors for class %s", 
-                     cls->nameForLogging());
-    }
-    if (fastpath((*ctor)(obj))) return obj;  // ctor called and succeeded - ok
-
-    supercls = cls->getSuperclass(); // this reload avoids a spill on the stack
-
-    // This class's ctor was called and failed.
-    // Call superclasses's dtors to clean up.
-    if (supercls) object_cxxDestructFromClass(obj, supercls);
-    if (flags & OBJECT_CONSTRUCT_FREE_ONFAILURE) free(obj);
-    if (flags & OBJECT_CONSTRUCT_CALL_BADALLOC) {
-        return _objc_callBadAllocHandler(cls);
+    const cxx_chain_t *chain = getCxxChain(cls);
+    const cxx_chain_t::entry_t *ctors = chain->constructors();
+    for (uint32_t i = 0; i < chain->constructCount; i++) {
+        if (PrintCxxCtors) {
+            _objc_inform("CXX: calling C++ constructors for class %s", 
+                         ctors[i].cls->nameForLogging());
+        }
+        if (fastpath(((id(*)(id))ctors[i].imp)(obj))) continue;
+
+        // This class's ctor was called and failed.
+        // Call superclasses's dtors to clean up.
+        object_cxxDestructFromClass(obj, ctors[i].cls->getSuperclass());
+        if (flags & OBJECT_CONSTRUCT_FREE_ONFAILURE) free(obj);
+        if (flags & OBJECT_CONSTRUCT_CALL_BADALLOC) {
+            return _objc_callBadAllocHandler(cls);
+        }
+        return nil;
     }
-    return nil;
+    return obj;
 }
 
 
@@ -829,6 +813,7 @@ size_t class_getInstanceSize(Class cls)
 unsigned int method_getNumberOfArguments(Method m)
 {
     if (!m) return 0;
+    if (auto sig = _method_auth(m)->signature()) return sig->argumentCount;
     return encoding_getNumberOfArguments(method_getTypeEncoding(m));
 }
 
@@ -864,33 +849,42 @@ char * method_copyArgumentType(Method m, unsigned int index)
 * Attempts to allocate num_requested objects, each with extraBytes.
 * Returns the number of allocated objects (possibly zero), with 
 * the allocated pointers in *results.
+* The objects are allocated with as few malloc calls as possible,
+* then all isas are set before any C++ constructor runs.
 **********************************************************************/
 unsigned
 _class_createInstances(Class cls, size_t extraBytes, id *results,
                        unsigned num_requested)
 {
-    unsigned num_allocated;
     if (!cls) return 0;
 
+    // Read class's info bits all at once for performance
+    bool hasCxxCtor = cls->hasCxxCtor();
+    bool hasCxxDtor = cls->hasCxxDtor();
+    bool fast = cls->canAllocNonpointer();
     size_t size = cls->instanceSize(extraBytes);
 
-    for (num_allocated = 0; num_allocated < num_requested; ++num_allocated) {
-        results[num_allocated] = objc::malloc_instance(size, cls);
-        if (!results[num_allocated])
-            break;
+    unsigned num_allocated =
+        objc::malloc_instances(size, cls, results, num_requested);
+
+    if (fast) {
+        for (unsigned i = 0; i < num_allocated; i++) {
+            results[i]->initInstanceIsa(cls, hasCxxDtor);
+        }
+    } else {
+        for (unsigned i = 0; i < num_allocated; i++) {
+            results[i]->initIsa(cls);
+        }
     }
 
+    if (fastpath(!hasCxxCtor)) return num_allocated;
+
     // Construct each object, and delete any that fail construction.
 
     unsigned shift = 0;
-    bool ctor = cls->hasCxxCtor();
     for (unsigned i = 0; i < num_allocated; i++) {
-        id obj = results[i];
-        obj->initIsa(cls);    // fixme allow nonpointer
-        if (ctor) {
-            obj = object_cxxConstructFromClass(obj, cls,
-                                               OBJECT_CONSTRUCT_FREE_ONFAILURE);
-        }
+        id obj = object_cxxConstructFromClass(results[i], cls,
+                                              OBJECT_CONSTRUCT_FREE_ONFAILURE);
         if (obj) {
             results[i-shift] = obj;
         } else {
@@ -5,6 +5,8 @@
 
 OPTION( PrintImages,                               Off, OBJC_PRINT_IMAGES,               "log image and library names as they are loaded")
 OPTION( PrintLoading,                              Off, OBJC_PRINT_LOAD_METHODS,         "log calls to class and category +load methods")
+OPTION( ProfileLoadMethods,                        Off, OBJC_PROFILE_LOAD_METHODS,       "time class and category +load methods and log the slowest after each image loads")
+OPTION( ProfileLoadMethodsFile,                    Off, OBJC_PROFILE_LOAD_METHODS_FILE,  "time class and category +load methods and write all of them to the named file as tab-separated lines")
 OPTION( PrintInitializing,                         Off, OBJC_PRINT_INITIALIZE_METHODS,   "log calls to class +initialize methods")
 OPTION( PrintResolving,                            Off, OBJC_PRINT_RESOLVED_METHODS,     "log methods created by +resolveClassMethod: and +resolveInstanceMethod:")
 OPTION( PrintConnecting,                           Off, OBJC_PRINT_CLASS_SETUP,          "log progress of class and category setup")
@@ -22,6 +24,7 @@ OPTION( PrintAltHandlers,                          Off, OBJC_PRINT_ALT_HANDLERS,
 OPTION( PrintReplacedMethods,                      Off, OBJC_PRINT_REPLACED_METHODS,     "log methods replaced by category implementations")
 OPTION( PrintDeprecation,                          Off, OBJC_PRINT_DEPRECATION_WARNINGS, "warn about calls to deprecated runtime functions")
 OPTION( PrintPoolHiwat,                            Off, OBJC_PRINT_POOL_HIGHWATER,       "log high-water marks for autorelease pools")
+OPTION( SamplePoolSites,                           Off, OBJC_SAMPLE_POOL_SITES,          "sample one in a set number of autorelease pool pushes and record pending entries by push site; see _objc_autoreleasePoolPrintSites")
 OPTION( PrintCustomCore,                           Off, OBJC_PRINT_CUSTOM_CORE,          "log classes with custom core methods")
 OPTION( PrintCustomRR,                             Off, OBJC_PRINT_CUSTOM_RR,            "log classes with custom retain/release methods")
 OPTION( PrintCustomAWZ,                            Off, OBJC_PRINT_CUSTOM_AWZ,           "log classes with custom allocWithZone methods")
@@ -29,8 +32,10 @@ OPTION( PrintRawIsa,                               Off, OBJC_PRINT_RAW_ISA,
 
 OPTION( DebugUnload,                               Off, OBJC_DEBUG_UNLOAD,               "warn about poorly-behaving bundles when unloaded")
 OPTION( DebugFragileSuperclasses,                  Off, OBJC_DEBUG_FRAGILE_SUPERCLASSES, "warn about subclasses that may have been broken by subsequent changes to superclasses")
+OPTION( ProfileWeakClears,                         Off, OBJC_PROFILE_WEAK_CLEARS,        "time the clearing of weak references to deallocated objects; see _objc_weak_getStatistics")
 OPTION( DebugNilSync,                              Off, OBJC_DEBUG_NIL_SYNC,             "warn about @synchronized(nil), which does no synchronization")
 OPTION( DebugSyncErrors,                           Off, OBJC_DEBUG_SYNC_ERRORS,          "warn when objc_sync_enter or objc_sync_exit return an error")
+OPTION( ProfileSyncContention,                     Off, OBJC_PROFILE_SYNC_CONTENTION,    "record contention on @synchronized locks and log the contended locks at exit; see _objc_sync_enumerateContention")
 OPTION( DebugNonFragileIvars,                      Off, OBJC_DEBUG_NONFRAGILE_IVARS,     "capriciously rearrange non-fragile ivars")
 OPTION( DebugAltHandlers,                          Off, OBJC_DEBUG_ALT_HANDLERS,         "record more info about bad alt handler use")
 OPTION( DebugMissingPools,                         Off, OBJC_DEBUG_MISSING_POOLS,        "warn about autorelease with no pool in place, which may be a leak")
@@ -38,8 +43,11 @@ OPTION( DebugPoolAllocation,                       Off, OBJC_DEBUG_POOL_ALLOCATI
 OPTION( DebugDuplicateClasses,                     On,  OBJC_DEBUG_DUPLICATE_CLASSES,    "warn when multiple classes with the same name are present")
 OPTION( DebugDontCrash,                            Off, OBJC_DEBUG_DONT_CRASH,           "halt the process by exiting instead of crashing")
 OPTION( DebugPoolDepth,                            Off, OBJC_DEBUG_POOL_DEPTH,           "log fault when at least a set number of autorelease pages has been allocated")
+OPTION( PoolSparePages,                            Off, OBJC_POOL_SPARE_PAGES,           "keep up to a set number of extra empty autorelease pool pages per thread for reuse (default 0)")
 OPTION( DebugScribbleCaches,                       Off, OBJC_DEBUG_SCRIBBLE_CACHES,      "scribble the IMPs in freed method caches")
 OPTION( DebugScanWeakTables,                       Off, OBJC_DEBUG_SCAN_WEAK_TABLES,     "scan the weak references table continuously in the background - set OBJC_DEBUG_SCAN_WEAK_TABLES_INTERVAL_NANOSECONDS to set scanning interval (default 1000000)")
+OPTION( BackgroundPoolRelease,                     Off, OBJC_BACKGROUND_POOL_RELEASE_THRESHOLD, "release autorelease pool entries of classes marked with _class_setThreadAgnosticDealloc on a background thread when a pool with at least a set number of entries is popped")
+OPTION( DeferDeallocation,                         Off, OBJC_DEFER_DEALLOCATION,         "destroy and free deallocated objects on a background thread after clearing their weak references")
 OPTION( DebugWeakErrors,                           On,  OBJC_DEBUG_WEAK_ERRORS,           "warn about misuse of objc_storeWeak/objc_loadWeak")
 OPTION( DisableVtables,                            Off, OBJC_DISABLE_VTABLES,            "disable vtable dispatch")
 OPTION( DisablePreopt,                             Off, OBJC_DISABLE_PREOPTIMIZATION,    "disable preoptimization courtesy of dyld shared cache")
@@ -52,6 +60,11 @@ OPTION( DisableFaults,                             Off, OBJC_DISABLE_FAULTS,
 OPTION( DisablePreoptCaches,                       Off, OBJC_DISABLE_PREOPTIMIZED_CACHES, "disable preoptimized caches")
 OPTION( DisableAutoreleaseCoalescing,              Off, OBJC_DISABLE_AUTORELEASE_COALESCING, "disable coalescing of autorelease pool pointers")
 OPTION( DisableAutoreleaseCoalescingLRU,           Off, OBJC_DISABLE_AUTORELEASE_COALESCING_LRU, "disable coalescing of autorelease pool pointers using look back N strategy")
+OPTION( AutoreleaseCoalescingLRUDepth,             Off, OBJC_AUTORELEASE_COALESCING_LRU_DEPTH, "look back a set number of autorelease pool entries for a match to coalesce with (default 4)")
+OPTION( DisablePoolPageGrowth,                     Off, OBJC_DISABLE_POOL_PAGE_GROWTH,   "disable larger autorelease pool pages for deep pools; every page is the minimum size")
+OPTION( DisableOptimisticWeakLoads,                Off, OBJC_DISABLE_OPTIMISTIC_WEAK_LOADS, "disable lock-free loads of weak references; always lock the side table")
+OPTION( DisableOptimisticPropertyReads,            Off, OBJC_DISABLE_OPTIMISTIC_PROPERTY_READS, "disable lock-free atomic property getters; always lock the property's stripe")
+OPTION( DisableThinSyncLocks,                      Off, OBJC_DISABLE_THIN_SYNC_LOCKS,    "disable thin locks for uncontended @synchronized; always allocate a mutex")
 
 INTERNAL_OPTION( DisableClassRXSigningEnforcement, Off, OBJC_DISABLE_CLASSRX_SIGNING_ENFORCEMENT, "disable class_rx_t pointer signing enforcement")
 INTERNAL_OPTION( DebugClassRXSigning,              Off, OBJC_DEBUG_CLASS_RX_SIGNING,     "warn about class_rx_t pointer signing mismatches")
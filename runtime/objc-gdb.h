@@ -261,6 +261,10 @@ OBJC_AVAILABLE(10.14.4, 12.2, 12.2, 5.2, 3.2);
 
 /***********************************************************************
 * AutoreleasePoolPage
+* Pages deeper in a thread's page chain may be larger than the first
+* pages. Use each page's next pointer to find the end of its contents.
+* A page can't be found by rounding an address down; follow the parent
+* and child links from the thread's hot page instead.
 **********************************************************************/
 OBJC_EXTERN const uint32_t objc_debug_autoreleasepoolpage_magic_offset  OBJC_AVAILABLE(10.15, 13.0, 13.0, 6.0, 5.0);
 OBJC_EXTERN const uint32_t objc_debug_autoreleasepoolpage_next_offset   OBJC_AVAILABLE(10.15, 13.0, 13.0, 6.0, 5.0);
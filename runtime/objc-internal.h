@@ -438,6 +438,98 @@ OBJC_EXPORT void
 _class_setCustomDeallocInitiation(_Nonnull Class cls);
 #define OBJC_SETCUSTOMDEALLOCINITIATION_DEFINED 1
 
+/**
+ * Mark a class as having deferred deallocation.
+ *
+ * When an instance of this class (or of any subclass) is disposed after
+ * `dealloc`, the runtime clears the weak references to it on the calling
+ * thread, and then hands it to a background thread which runs its C++
+ * destructors and ARC ivar cleanup, removes its associated objects, and frees
+ * its memory. This keeps the cost of tearing down large object graphs off the
+ * thread that performed the final release.
+ *
+ * Because weak references are cleared before `object_dispose` returns, weak
+ * loads behave exactly as they do for synchronous deallocation. Everything
+ * else that `objc_destructInstance` does, including the release of objects
+ * held in strong ivars and associations, happens later on another thread.
+ * Only use this for classes whose ivars and associated objects may be
+ * released from any thread.
+ *
+ * Setting OBJC_DEFER_DEALLOCATION=YES in the environment enables this for
+ * all classes.
+ *
+ * @param cls The class to modify.
+ */
+OBJC_EXPORT void
+_class_setDeferredDeallocation(_Nonnull Class cls);
+
+/**
+ * Mark a class, and all of its subclasses, as safe to release and
+ * deallocate from any thread. This includes its -release and -dealloc
+ * methods and the release of everything its instances own.
+ *
+ * When OBJC_BACKGROUND_POOL_RELEASE_THRESHOLD is set, popping an autorelease
+ * pool with at least that many entries hands the entries for instances of
+ * these classes to a background thread to release. The popping thread
+ * releases everything else as usual and returns without waiting.
+ *
+ * @param cls The class to modify.
+ */
+OBJC_EXPORT void
+_class_setThreadAgnosticDealloc(_Nonnull Class cls);
+
+/**
+ * Mark a class, and all of its subclasses, as recycling the memory of
+ * its instances. Freed instances of up to 256 bytes are kept on per-thread
+ * free lists, sorted by size, and reused by the next allocation of any
+ * marked class of that size. Each thread moves batches of them to a
+ * process-wide pool when its lists grow too long and takes batches back
+ * when its lists run dry.
+ *
+ * Deallocation still runs C++ destructors, removes associated objects,
+ * and clears weak references before the memory is pooled. Only instances
+ * allocated without extra bytes come from the pools.
+ *
+ * Does nothing when the runtime is built with typed malloc, which keeps
+ * the memory of different types apart.
+ *
+ * @param cls The class to modify.
+ */
+OBJC_EXPORT void
+_class_setPooledInstances(_Nonnull Class cls);
+
+// Process-wide instance pool counters for _class_setPooledInstances.
+// allocations and hits count instances of marked classes allocated, and
+// those served from a pool. frees counts freed instances of marked
+// classes. retainedBytes is the freed memory held in the pools.
+// Other threads' counts are included as of their last exchange with the
+// process-wide pool or their exit. The calling thread's are current.
+typedef struct {
+    uint64_t allocations;
+    uint64_t hits;
+    uint64_t frees;
+    uint64_t retainedBytes;
+} objc_instance_pool_statistics_t;
+
+OBJC_EXPORT void
+_objc_getInstancePoolStatistics(objc_instance_pool_statistics_t * _Nonnull stats);
+
+#if !TARGET_OS_EXCLAVEKIT
+/**
+ * Creates IMPs for several blocks at once. The result is the same as
+ * calling imp_implementationWithBlock() on each block, but trampolines
+ * are taken in batches.
+ *
+ * @param blocks The blocks. Each is copied with \c Block_copy().
+ * @param imps On return, the IMP for each block. Each must be disposed
+ *  of with \c imp_removeBlock.
+ * @param count The number of blocks.
+ */
+OBJC_EXPORT void
+imp_implementationWithBlocks(id _Nonnull const * _Nonnull blocks,
+                             IMP _Nonnull * _Nonnull imps, unsigned count);
+#endif
+
 // Tagged pointer objects.
 
 #if __LP64__
@@ -1080,6 +1172,59 @@ OBJC_EXPORT BOOL
 objc_sync_try_enter(id _Nonnull obj)
     OBJC_AVAILABLE(10.15, 13.0, 13.0, 6.0, 5.0);
 
+// Shared variants of objc_sync_enter and objc_sync_exit. Any number of
+// threads may hold an object's lock shared at once, but not while another
+// thread holds it through objc_sync_enter. A thread holding the lock
+// exclusively may also take it shared. Taking it exclusively while holding
+// it only shared is a fatal error. A thread holding the lock both ways
+// must release its holds in the reverse of the order it took them.
+OBJC_EXPORT int
+_objc_sync_enter_shared(id _Nonnull obj);
+
+OBJC_EXPORT int
+_objc_sync_exit_shared(id _Nonnull obj);
+
+// Contention records for @synchronized locks, gathered when
+// OBJC_PROFILE_SYNC_CONTENTION is set. object is the locked object's
+// address and cls its class, recorded at the first contended acquisition.
+// A contended acquisition is one that had to wait for another thread;
+// waitNanoseconds is the total time spent waiting. Locks that were never
+// contended may be discarded when idle, taking their counts with them.
+// objc_sync_try_enter is not counted.
+typedef struct {
+    const void * _Nullable object;
+    Class _Nullable cls;
+    uint64_t acquisitions;
+    uint64_t contendedAcquisitions;
+    uint64_t waitNanoseconds;
+} objc_sync_contention_t;
+
+// Calls block once for each lock with recorded acquisitions.
+OBJC_EXPORT void
+_objc_sync_enumerateContention(void (^ _Nonnull block)(const objc_sync_contention_t * _Nonnull record));
+
+// Logs every contended lock, longest total wait first. This also runs at
+// exit when OBJC_PROFILE_SYNC_CONTENTION is set and any lock was contended.
+OBJC_EXPORT void
+_objc_sync_printContention(void);
+
+// Statistics for the @synchronized lock tables.
+// liveEntries counts locks in use by at least one thread. idleEntries
+// counts locks kept for reuse that no thread is using. capacity is the
+// total number of table slots. maxProbeLength is the longest probe
+// sequence needed to find an entry. entriesReclaimed counts idle entries
+// removed from the tables since launch.
+typedef struct {
+    size_t liveEntries;
+    size_t idleEntries;
+    size_t capacity;
+    size_t maxProbeLength;
+    uint64_t entriesReclaimed;
+} objc_sync_statistics_t;
+
+OBJC_EXPORT void
+_objc_sync_getStatistics(objc_sync_statistics_t * _Nonnull stats);
+
 OBJC_EXPORT id _Nullable
 objc_retain(id _Nullable obj)
     __asm__("_objc_retain")
@@ -1173,11 +1318,87 @@ OBJC_EXPORT void
 objc_moveWeak(id _Nullable * _Nonnull to, id _Nullable * _Nonnull from) 
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
 
+// Weak reference table statistics for one side table.
+// referrersHistogram[i] counts objects with 1, 2, 3-4, 5-8, 9-16, 17-32,
+// 33-64, and more than 64 weak references, respectively.
+// Clear times cover weak_clear_no_lock with the side table lock held.
+// They are recorded only when OBJC_PROFILE_WEAK_CLEARS is set.
+typedef struct objc_weak_statistics {
+    size_t entries;             // weakly referenced objects
+    size_t capacity;            // allocated entry buckets
+    size_t referrers;           // registered weak variables
+    size_t maxProbeLength;      // longest entry probe sequence
+    size_t referrersHistogram[8];
+    uint64_t growCount;         // entry table grows
+    uint64_t compactCount;      // entry table shrinks
+    uint64_t clearCount;        // objects whose weak references were cleared
+    uint64_t clearNanoseconds;  // total time spent clearing
+    uint64_t maxClearNanoseconds;
+} objc_weak_statistics_t;
+
+// Copies the weak table statistics of up to `count` side tables into
+// `stats` and returns the number of side tables. Each side table is
+// locked only while its own statistics are gathered.
+OBJC_EXPORT unsigned
+_objc_weak_getStatistics(objc_weak_statistics_t * _Nullable stats,
+                         unsigned count);
+
 
 OBJC_EXPORT void
 _objc_autoreleasePoolPrint(void)
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
 
+// Process-wide autorelease pool counters.
+// pagesReused counts pages that were filled again after being emptied,
+// instead of allocating a new page. OBJC_POOL_SPARE_PAGES sets how many
+// extra empty pages each thread keeps for reuse. By default a thread
+// keeps at most one, after popping a pool that ends in a page more than
+// half full.
+// entriesCoalesced counts autoreleases that were folded into an existing
+// pool entry instead of taking a new one. It is updated when the entries
+// are released. OBJC_AUTORELEASE_COALESCING_LRU_DEPTH sets how many
+// recent entries are searched for a match.
+typedef struct {
+    uint64_t pagesAllocated;
+    uint64_t pagesFreed;
+    uint64_t pagesReused;
+    uint64_t entriesCoalesced;
+} objc_autoreleasepool_statistics_t;
+
+OBJC_EXPORT void
+_objc_autoreleasePoolGetStatistics(objc_autoreleasepool_statistics_t * _Nonnull stats);
+
+// Autorelease pool push site records, gathered when OBJC_SAMPLE_POOL_SITES
+// is set to a sampling interval N. One in every N pool pushes on each
+// thread is sampled. address is the return address of the sampled
+// objc_autoreleasePoolPush call. When a sampled pool is popped, the
+// entries still pending in it are counted and tallied by class.
+// maxEntries is the site's high-water mark: the most slots any of its
+// sampled pools used between push and pop, including entries already
+// released by inner pools and the inner pools' boundaries.
+// Only the first 8 classes seen at a site are counted separately.
+typedef struct {
+    const void * _Nullable address;
+    uint64_t samples;
+    uint64_t maxEntries;
+    uint64_t totalEntries;
+    struct {
+        Class _Nullable cls;
+        uint64_t count;
+    } classes[8];
+    uint64_t otherClasses;
+} objc_autoreleasepool_site_t;
+
+// Copies up to `count` site records into `sites` and returns the number
+// of sites recorded.
+OBJC_EXPORT unsigned
+_objc_autoreleasePoolCopySites(objc_autoreleasepool_site_t * _Nullable sites,
+                               unsigned count);
+
+// Logs every site record, largest maximum first.
+OBJC_EXPORT void
+_objc_autoreleasePoolPrintSites(void);
+
 OBJC_EXPORT BOOL
 objc_should_deallocate(id _Nonnull object)
     OBJC_AVAILABLE(10.7, 5.0, 9.0, 1.0, 2.0);
@@ -29,6 +29,12 @@
 #include "objc-loadmethod.h"
 #include "objc-private.h"
 
+#include <algorithm>
+
+namespace objc {
+    extern const char *LoadProfilePath;
+}
+
 typedef void(*load_method_t)(id, SEL);
 
 struct loadable_class {
@@ -54,6 +60,197 @@ static int loadable_categories_used = 0;
 static int loadable_categories_allocated = 0;
 
 
+/***********************************************************************
+* +load profiling
+* With OBJC_PROFILE_LOAD_METHODS or OBJC_PROFILE_LOAD_METHODS_FILE set, 
+* the wall clock and thread CPU time of every +load call is recorded. 
+* The outermost call_load_methods() reports its calls slowest first: 
+* the slowest few are logged, and all of them are written to the file 
+* as tab-separated lines.
+* Each call's times exclude any +load calls made while it ran, which
+* are recorded separately, so that the total counts them only once.
+**********************************************************************/
+struct load_profile_record {
+    Class cls;
+    Category cat;  // nil for a class +load
+    IMP method;
+    uint64_t wallTime;
+    uint64_t cpuTime;
+};
+
+#define LOAD_PROFILE_LOG_COUNT 20
+
+static struct load_profile_record *load_profile_records = nil;
+static int load_profile_records_used = 0;
+static int load_profile_records_allocated = 0;
+static int load_profile_fd = -1;
+
+// Time spent in +load calls made inside the +load call being timed.
+static uint64_t load_profile_nested_wall = 0;
+static uint64_t load_profile_nested_cpu = 0;
+
+static bool load_profiling(void)
+{
+    return ProfileLoadMethods  ||  objc::LoadProfilePath;
+}
+
+static uint64_t thread_cpu_nanoseconds(void)
+{
+#if TARGET_OS_EXCLAVEKIT
+    return 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(1000000000) * ts.tv_sec + ts.tv_nsec;
+#endif
+}
+
+
+/***********************************************************************
+* call_load_method
+* Call one +load method, timing it if +load profiling is enabled.
+* cat is the category that implements it, or nil for a class +load.
+**********************************************************************/
+static void call_load_method(Class cls, Category cat, IMP method)
+{
+    load_method_t load_method = (load_method_t)method;
+
+    if (fastpath(!load_profiling())) {
+        (*load_method)(cls, @selector(load));
+        return;
+    }
+
+    uint64_t outerNestedWall = load_profile_nested_wall;
+    uint64_t outerNestedCpu = load_profile_nested_cpu;
+    load_profile_nested_wall = 0;
+    load_profile_nested_cpu = 0;
+
+    uint64_t wallStart = nanoseconds();
+    uint64_t cpuStart = thread_cpu_nanoseconds();
+    (*load_method)(cls, @selector(load));
+    uint64_t cpuTime = thread_cpu_nanoseconds() - cpuStart;
+    uint64_t wallTime = nanoseconds() - wallStart;
+
+    // Charge this call's whole time to the +load that called us, if any,
+    // and only its own time to this record.
+    uint64_t nestedWall = load_profile_nested_wall;
+    uint64_t nestedCpu = load_profile_nested_cpu;
+    load_profile_nested_wall = outerNestedWall + wallTime;
+    load_profile_nested_cpu = outerNestedCpu + cpuTime;
+    wallTime -= std::min(wallTime, nestedWall);
+    cpuTime -= std::min(cpuTime, nestedCpu);
+
+    if (load_profile_records_used == load_profile_records_allocated) {
+        load_profile_records_allocated = load_profile_records_allocated*2 + 16;
+        load_profile_records = (struct load_profile_record *)
+            realloc(load_profile_records,
+                              load_profile_records_allocated *
+                              sizeof(struct load_profile_record));
+    }
+
+    struct load_profile_record *record =
+        &load_profile_records[load_profile_records_used++];
+    record->cls = cls;
+    record->cat = cat;
+    record->method = method;
+    record->wallTime = wallTime;
+    record->cpuTime = cpuTime;
+}
+
+
+/***********************************************************************
+* load_profile_image
+* Return the path of the image containing a +load method, or "".
+**********************************************************************/
+static const char *load_profile_image(IMP method)
+{
+    const void *address = (const void *)method;
+#if __has_feature(ptrauth_calls)
+    address = ptrauth_strip(address, ptrauth_key_function_pointer);
+#endif
+    const char *path = dyld_image_path_containing_address(address);
+    return path ? path : "";
+}
+
+
+/***********************************************************************
+* report_load_profile
+* Log and write out the +load calls recorded since the last report, 
+* slowest first, and discard them.
+*
+* Called only by call_load_methods().
+**********************************************************************/
+static void report_load_profile(void)
+{
+    struct load_profile_record *records = load_profile_records;
+    int used = load_profile_records_used;
+    load_profile_records = nil;
+    load_profile_records_allocated = 0;
+    load_profile_records_used = 0;
+
+    if (used == 0) {
+        if (records) free(records);
+        return;
+    }
+
+    std::sort(records, records + used,
+              [](const load_profile_record &a, const load_profile_record &b) {
+        return a.wallTime > b.wallTime;
+    });
+
+    if (ProfileLoadMethods) {
+        uint64_t totalWall = 0, totalCpu = 0;
+        for (int i = 0; i < used; i++) {
+            totalWall += records[i].wallTime;
+            totalCpu += records[i].cpuTime;
+        }
+        _objc_inform("LOAD: %d +load methods took %llu us (%llu us CPU)",
+                     used, (unsigned long long)(totalWall / 1000),
+                     (unsigned long long)(totalCpu / 1000));
+        for (int i = 0; i < used  &&  i < LOAD_PROFILE_LOG_COUNT; i++) {
+            const load_profile_record &record = records[i];
+            _objc_inform("LOAD: %8llu us %8llu us CPU  +[%s%s%s%s load]  %s",
+                         (unsigned long long)(record.wallTime / 1000),
+                         (unsigned long long)(record.cpuTime / 1000),
+                         record.cls->nameForLogging(),
+                         record.cat ? "(" : "",
+                         record.cat ? _category_getName(record.cat) : "",
+                         record.cat ? ")" : "",
+                         load_profile_image(record.method));
+        }
+    }
+
+#if !TARGET_OS_EXCLAVEKIT
+    if (objc::LoadProfilePath  &&  load_profile_fd < 0) {
+        load_profile_fd = open(objc::LoadProfilePath,
+                               O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (load_profile_fd < 0) {
+            _objc_inform("LOAD: could not open %s for +load profiling: %s",
+                         objc::LoadProfilePath, strerror(errno));
+            objc::LoadProfilePath = nil;
+        } else {
+            dprintf(load_profile_fd,
+                    "wall_ns\tcpu_ns\tkind\tclass\tcategory\timage\n");
+        }
+    }
+    if (load_profile_fd >= 0) {
+        for (int i = 0; i < used; i++) {
+            const load_profile_record &record = records[i];
+            dprintf(load_profile_fd, "%llu\t%llu\t%s\t%s\t%s\t%s\n",
+                    (unsigned long long)record.wallTime,
+                    (unsigned long long)record.cpuTime,
+                    record.cat ? "category" : "class",
+                    record.cls->nameForLogging(),
+                    record.cat ? _category_getName(record.cat) : "",
+                    load_profile_image(record.method));
+        }
+    }
+#endif
+
+    free(records);
+}
+
+
 /***********************************************************************
 * add_class_to_loadable_list
 * Class cls has just become connected. Schedule it for +load if
@@ -195,13 +392,12 @@ static void call_class_loads(void)
     // Call all +loads for the detached list.
     for (i = 0; i < used; i++) {
         Class cls = classes[i].cls;
-        load_method_t load_method = (load_method_t)classes[i].method;
         if (!cls) continue; 
 
         if (PrintLoading) {
             _objc_inform("LOAD: +[%s load]\n", cls->nameForLogging());
         }
-        (*load_method)(cls, @selector(load));
+        call_load_method(cls, nil, classes[i].method);
     }
     
     // Destroy the detached list.
@@ -237,7 +433,6 @@ static bool call_category_loads(void)
     // Call all +loads for the detached list.
     for (i = 0; i < used; i++) {
         Category cat = cats[i].cat;
-        load_method_t load_method = (load_method_t)cats[i].method;
         Class cls;
         if (!cat) continue;
 
@@ -248,7 +443,7 @@ static bool call_category_loads(void)
                              cls->nameForLogging(), 
                              _category_getName(cat));
             }
-            (*load_method)(cls, @selector(load));
+            call_load_method(cls, cat, cats[i].method);
             cats[i].cat = nil;
         }
     }
@@ -330,6 +525,8 @@ static bool call_category_loads(void)
 * Category +loads are only run once to ensure "parent class first" 
 * ordering, even if a category +load triggers a new loadable class 
 * and a new loadable category attached to that class. 
+* 
+* If +load profiling is enabled, the calls made are reported at the end.
 *
 * Locking: loadMethodLock must be held by the caller 
 *   All other locks must not be held.
@@ -361,6 +558,8 @@ void call_load_methods(void)
 
     objc_autoreleasePoolPop(pool);
 
+    if (load_profiling()) report_load_profile();
+
     loading = NO;
 }
 
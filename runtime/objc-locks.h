@@ -35,9 +35,26 @@
 // Lock ordering is declared in _objc_fork_prepare()
 // and is enforced by lockdebug.
 
+// A StructLocks stripe. Writers in objc_copyStruct() hold the lock and
+// make the sequence number odd while they copy; readers retry if the
+// sequence number changed during their copy.
+struct StructLock {
+    spinlock_t slock;
+    explicit_atomic<uintptr_t> sequence{0};
+
+    void lock() { slock.lock(); }
+    void unlock() { slock.unlock(); }
+    void reset() {
+        slock.reset();
+        sequence.store(sequence.load(std::memory_order_relaxed) & ~(uintptr_t)1,
+                       std::memory_order_relaxed);
+    }
+};
+
 extern mutex_t classInitLock;
 extern mutex_t pendingInitializeMapLock;
 extern mutex_t selLock;
+extern mutex_t TypeEncodingCacheLock;
 #if CONFIG_USE_CACHE_LOCK
 extern mutex_t cacheUpdateLock;
 #endif
@@ -45,9 +62,8 @@ extern recursive_mutex_t loadMethodLock;
 extern mutex_t crashlog_lock;
 extern spinlock_t objcMsgLogLock;
 extern mutex_t AltHandlerDebugLock;
-extern mutex_t AssociationsManagerLock;
 extern StripedMap<spinlock_t> PropertyLocks;
-extern StripedMap<spinlock_t> StructLocks;
+extern StripedMap<StructLock> StructLocks;
 extern StripedMap<spinlock_t> CppObjectLocks;
 
 // SideTable lock is buried awkwardly. Call a function to manipulate it.
@@ -60,6 +76,16 @@ extern void SideTableLocksSucceedLock(const void *oldlock);
 extern void SideTableLocksPrecedeLocks(StripedMap<spinlock_t>& newlocks);
 extern void SideTableLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks);
 
+// Associated object locks are buried in objc-references.mm.
+extern void AssociationsLockAll();
+extern void AssociationsUnlockAll();
+extern void AssociationsForceResetAll();
+extern void AssociationsDefineLockOrder();
+extern void AssociationsLocksPrecedeLock(const void *newlock);
+extern void AssociationsLocksSucceedLock(const void *oldlock);
+extern void AssociationsLocksPrecedeSideTableLocks();
+extern void AssociationsLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks);
+
 #include "objc-locks-new.h"
 
 #endif
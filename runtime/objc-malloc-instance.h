@@ -25,8 +25,12 @@
 #define _OBJC_MALLOC_INSTANCE_H
 
 #include <cstdlib>
+#include <cstring>
 #if _MALLOC_TYPE_ENABLED
 # include <malloc_type_private.h>
+#elif __has_include(<malloc/malloc.h>)
+# include <malloc/malloc.h>
+# define OBJC_MALLOC_INSTANCES_BATCH 1
 #endif
 
 namespace objc {
@@ -43,6 +47,32 @@ malloc_instance(size_t size, Class cls __unused)
 #endif
 }
 
+// Allocates up to count zero-filled instances of the same size.
+// Returns the number allocated, stored in results[0..n).
+static inline unsigned
+malloc_instances(size_t size, Class cls, id *results, unsigned count)
+{
+    unsigned allocated = 0;
+
+#if OBJC_MALLOC_INSTANCES_BATCH
+    // One call into malloc for as many as it will give us.
+    // Unlike calloc, batch malloc does not zero the memory.
+    allocated = malloc_zone_batch_malloc(malloc_default_zone(), size,
+                                         (void **)results, count);
+    for (unsigned i = 0; i < allocated; i++) {
+        bzero(results[i], size);
+    }
+#endif
+
+    // Batch malloc only serves small sizes, and may return fewer.
+    for ( ; allocated < count; allocated++) {
+        results[allocated] = malloc_instance(size, cls);
+        if (!results[allocated]) break;
+    }
+
+    return allocated;
+}
+
 } // namespace objc
 
 #endif // _OBJC_MALLOC_INSTANCE_H
@@ -597,7 +597,14 @@ objc_object::rootDealloc()
                  !isa().has_sidetable_rc))
     {
         assert(!sidetable_present());
-        free(this);
+        Class cls = isa().getClass(false);
+        if (slowpath(PooledInstancesEnabled.load(std::memory_order_relaxed))  &&
+            cls->hasPooledInstances())
+        {
+            _objc_freePooledInstance((id)this, cls);
+        } else {
+            free(this);
+        }
     } 
     else {
         object_dispose((id)this);
@@ -735,6 +742,48 @@ objc_object::rootRetain(bool tryRetain, objc_object::RRVariant variant)
 }
 
 
+#if ISA_HAS_INLINE_RC
+// Base tryRetain implementation that never touches the side table,
+// for callers that do not hold the side table lock.
+// Returns false if the object is deallocating.
+// Returns false and sets *needsSideTable if the object has a raw isa or
+// the retain count would overflow; the caller must then retry with
+// the side table locked.
+ALWAYS_INLINE bool
+objc_object::rootTryRetainInline(bool *needsSideTable)
+{
+    ASSERT(!isTaggedPointer());
+
+    isa_t oldisa;
+    isa_t newisa;
+
+    *needsSideTable = false;
+    oldisa = LoadExclusive(&isa().bits);
+    do {
+        newisa = oldisa;
+        if (slowpath(!newisa.nonpointer)) {
+            ClearExclusive(&isa().bits);
+            *needsSideTable = true;
+            return false;
+        }
+        if (slowpath(newisa.isDeallocating())) {
+            ClearExclusive(&isa().bits);
+            return false;
+        }
+        uintptr_t carry;
+        newisa.bits = addc(newisa.bits, RC_ONE, 0, &carry);  // extra_rc++
+        if (slowpath(carry)) {
+            ClearExclusive(&isa().bits);
+            *needsSideTable = true;
+            return false;
+        }
+    } while (slowpath(!StoreExclusive(&isa().bits, &oldisa.bits, newisa.bits)));
+
+    return true;
+}
+#endif
+
+
 // Equivalent to calling [this release], with shortcuts if there is no override
 inline void
 objc_object::release()
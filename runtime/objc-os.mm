@@ -724,13 +724,14 @@ static void defineLockOrder()
     lockdebug::lock_precedes_lock(&pendingInitializeMapLock, &crashlog_lock);
     lockdebug::lock_precedes_lock(&runtimeLock, &crashlog_lock);
     lockdebug::lock_precedes_lock(&DemangleCacheLock, &crashlog_lock);
+    lockdebug::lock_precedes_lock(&TypeEncodingCacheLock, &crashlog_lock);
     lockdebug::lock_precedes_lock(&selLock, &crashlog_lock);
 #if CONFIG_USE_CACHE_LOCK
     lockdebug::lock_precedes_lock(&cacheUpdateLock, &crashlog_lock);
 #endif
     lockdebug::lock_precedes_lock(&objcMsgLogLock, &crashlog_lock);
     lockdebug::lock_precedes_lock(&AltHandlerDebugLock, &crashlog_lock);
-    lockdebug::lock_precedes_lock(&AssociationsManagerLock, &crashlog_lock);
+    AssociationsLocksPrecedeLock(&crashlog_lock);
     SideTableLocksPrecedeLock(&crashlog_lock);
     PropertyLocks.precedeLock(&crashlog_lock);
     StructLocks.precedeLock(&crashlog_lock);
@@ -742,29 +743,31 @@ static void defineLockOrder()
     lockdebug::lock_precedes_lock(&loadMethodLock, &pendingInitializeMapLock);
     lockdebug::lock_precedes_lock(&loadMethodLock, &runtimeLock);
     lockdebug::lock_precedes_lock(&loadMethodLock, &DemangleCacheLock);
+    lockdebug::lock_precedes_lock(&loadMethodLock, &TypeEncodingCacheLock);
     lockdebug::lock_precedes_lock(&loadMethodLock, &selLock);
 #if CONFIG_USE_CACHE_LOCK
     lockdebug::lock_precedes_lock(&loadMethodLock, &cacheUpdateLock);
 #endif
     lockdebug::lock_precedes_lock(&loadMethodLock, &objcMsgLogLock);
     lockdebug::lock_precedes_lock(&loadMethodLock, &AltHandlerDebugLock);
-    lockdebug::lock_precedes_lock(&loadMethodLock, &AssociationsManagerLock);
+    AssociationsLocksSucceedLock(&loadMethodLock);
     SideTableLocksSucceedLock(&loadMethodLock);
     PropertyLocks.succeedLock(&loadMethodLock);
     StructLocks.succeedLock(&loadMethodLock);
     CppObjectLocks.succeedLock(&loadMethodLock);
 
-    // PropertyLocks and CppObjectLocks and AssociationManagerLock 
+    // PropertyLocks and CppObjectLocks and the associations locks
     // precede everything because they are held while objc_retain() 
     // or C++ copy are called.
     // (StructLocks do not precede everything because it calls memmove only.)
     auto PropertyAndCppObjectAndAssocLocksPrecedeLock = [&](const void *lock) {
         PropertyLocks.precedeLock(lock);
         CppObjectLocks.precedeLock(lock);
-        lockdebug::lock_precedes_lock(&AssociationsManagerLock, lock);
+        AssociationsLocksPrecedeLock(lock);
     };
     PropertyAndCppObjectAndAssocLocksPrecedeLock(&runtimeLock);
     PropertyAndCppObjectAndAssocLocksPrecedeLock(&DemangleCacheLock);
+    PropertyAndCppObjectAndAssocLocksPrecedeLock(&TypeEncodingCacheLock);
     PropertyAndCppObjectAndAssocLocksPrecedeLock(&classInitLock);
     PropertyAndCppObjectAndAssocLocksPrecedeLock(&selLock);
 #if CONFIG_USE_CACHE_LOCK
@@ -775,10 +778,10 @@ static void defineLockOrder()
 
     SideTableLocksSucceedLocks(PropertyLocks);
     SideTableLocksSucceedLocks(CppObjectLocks);
-    SideTableLocksSucceedLock(&AssociationsManagerLock);
+    AssociationsLocksPrecedeSideTableLocks();
 
-    PropertyLocks.precedeLock(&AssociationsManagerLock);
-    CppObjectLocks.precedeLock(&AssociationsManagerLock);
+    AssociationsLocksSucceedLocks(PropertyLocks);
+    AssociationsLocksSucceedLocks(CppObjectLocks);
 
     lockdebug::lock_precedes_lock(&classInitLock, &runtimeLock);
     lockdebug::lock_precedes_lock(&pendingInitializeMapLock, &runtimeLock);
@@ -793,9 +796,11 @@ static void defineLockOrder()
     lockdebug::lock_precedes_lock(&runtimeLock, &cacheUpdateLock);
 #endif
     lockdebug::lock_precedes_lock(&runtimeLock, &DemangleCacheLock);
+    lockdebug::lock_precedes_lock(&runtimeLock, &TypeEncodingCacheLock);
 
     // Striped locks use address order internally.
     SideTableDefineLockOrder();
+    AssociationsDefineLockOrder();
     PropertyLocks.defineLockOrder();
     StructLocks.defineLockOrder();
     CppObjectLocks.defineLockOrder();
@@ -819,12 +824,13 @@ void _objc_atfork_prepare()
     loadMethodLock.lock();
     PropertyLocks.lockAll();
     CppObjectLocks.lockAll();
-    AssociationsManagerLock.lock();
+    AssociationsLockAll();
     SideTableLockAll();
     classInitLock.lock();
     pendingInitializeMapLock.lock();
     runtimeLock.lock();
     DemangleCacheLock.lock();
+    TypeEncodingCacheLock.lock();
     selLock.lock();
 #if CONFIG_USE_CACHE_LOCK
     cacheUpdateLock.lock();
@@ -845,7 +851,7 @@ void _objc_atfork_parent()
     CppObjectLocks.unlockAll();
     StructLocks.unlockAll();
     PropertyLocks.unlockAll();
-    AssociationsManagerLock.unlock();
+    AssociationsUnlockAll();
     AltHandlerDebugLock.unlock();
     objcMsgLogLock.unlock();
     crashlog_lock.unlock();
@@ -856,6 +862,7 @@ void _objc_atfork_parent()
     selLock.unlock();
     SideTableUnlockAll();
     DemangleCacheLock.unlock();
+    TypeEncodingCacheLock.unlock();
     runtimeLock.unlock();
     classInitLock.unlock();
     pendingInitializeMapLock.unlock();
@@ -879,7 +886,7 @@ void _objc_atfork_child()
     CppObjectLocks.forceResetAll();
     StructLocks.forceResetAll();
     PropertyLocks.forceResetAll();
-    AssociationsManagerLock.reset();
+    AssociationsForceResetAll();
     AltHandlerDebugLock.reset();
     objcMsgLogLock.reset();
     crashlog_lock.reset();
@@ -890,6 +897,7 @@ void _objc_atfork_child()
     selLock.reset();
     SideTableForceResetAll();
     DemangleCacheLock.reset();
+    TypeEncodingCacheLock.reset();
     runtimeLock.reset();
     classInitLock.reset();
     pendingInitializeMapLock.reset();
@@ -898,6 +906,8 @@ void _objc_atfork_child()
 
     classInitializeAtforkChild();
 
+    _objc_deferredDeallocAtforkChild();
+
     lockdebug::assert_no_locks_locked();
 }
 
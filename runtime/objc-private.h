@@ -190,6 +190,9 @@ public:
     bool rootRelease();
     id rootAutorelease();
     bool rootTryRetain();
+#if ISA_HAS_INLINE_RC
+    bool rootTryRetainInline(bool *needsSideTable);
+#endif
     bool rootReleaseShouldDealloc();
     uintptr_t rootRetainCount() const;
 
@@ -582,6 +585,24 @@ extern IMP lookUpImpOrNilTryCache(id obj, SEL, Class cls, int behavior = 0);
 
 extern IMP lookupMethodInClassAndLoadCache(Class cls, SEL sel);
 
+// The .cxx_construct and .cxx_destruct IMPs to call for instances of a
+// class, in the order to call them. See objc-runtime-new.mm.
+struct cxx_chain_t {
+    struct entry_t {
+        Class cls;
+        IMP imp;
+    };
+
+    uint32_t constructCount;  // root class first
+    uint32_t destructCount;   // cls first
+    entry_t entries[0];
+
+    const entry_t *constructors() const { return entries; }
+    const entry_t *destructors() const { return entries + constructCount; }
+};
+
+extern const cxx_chain_t *getCxxChain(Class cls);
+
 struct IMPAndSEL {
     IMP imp;
     SEL sel;
@@ -671,6 +692,9 @@ struct _objc_pthread_data {
     const char **classNameLookups;  // for objc_getClass() hooks
     unsigned classNameLookupsAllocated;
     unsigned classNameLookupsUsed;
+    struct weak_hazard_t *weakHazard;  // for lock-free weak loads
+    struct pool_sample_list *poolSamples;  // for autorelease pool site sampling
+    struct instance_pool_t *instancePool;  // for _class_setPooledInstances
 
     // If you add new fields here, don't forget to update the destructor
     ~_objc_pthread_data();
@@ -679,6 +703,22 @@ struct _objc_pthread_data {
 extern _objc_pthread_data *_objc_fetch_pthread_data(bool create);
 
 // encoding.h
+// A method type encoding, parsed. Type spans are offsets into types.
+struct method_signature_t {
+    struct argument_t {
+        uint32_t typeStart;
+        uint32_t typeLength;
+        int32_t offset;  // from self, as encoding_getArgumentInfo
+    };
+
+    const char *types;
+    uint32_t argumentCount;
+    uint32_t frameSize;
+    argument_t returnType;
+    argument_t arguments[0];
+};
+
+extern const method_signature_t *encoding_getSignature(const char *types);
 extern unsigned int encoding_getNumberOfArguments(const char *typedesc);
 extern unsigned int encoding_getSizeOfArguments(const char *typedesc);
 extern unsigned int encoding_getArgumentInfo(const char *typedesc, unsigned int arg, const char **type, int *offset);
@@ -710,6 +750,16 @@ extern int _objc_sync_exit_kind(id obj, SyncKind kind);
 // arr
 extern void arr_init(void);
 extern id objc_autoreleaseReturnValue(id obj);
+extern explicit_atomic<bool> DeferredDeallocationStarted;
+extern explicit_atomic<bool> BackgroundPoolReleaseStarted;
+extern void _objc_startDeferredDeallocation(void);
+extern void _objc_startBackgroundPoolRelease(void);
+extern void _objc_deferredDeallocAtforkChild(void);
+extern bool _object_deferDispose(id obj);
+extern explicit_atomic<bool> PooledInstancesEnabled;
+extern id _objc_allocPooledInstance(Class cls, size_t size);
+extern void _objc_freePooledInstance(id obj, Class cls);
+extern void _objc_instancePoolDestroy(struct instance_pool_t *pool);
 
 // block trampolines
 #if !TARGET_OS_EXCLAVEKIT
@@ -231,16 +231,12 @@ template <typename T> using RawPtr = WrappedPtr<T, PtrauthRaw>;
 // These protect various things in objc-block-trampolines.
 #if __has_feature(ptrauth_calls)
 
-#define ptrauth_trampoline_block_page_group \
-    __ptrauth(ptrauth_key_process_dependent_data, 1, \
-        ptrauth_string_discriminator("TrampolineBlockPageGroup"))
 #define ptrauth_trampoline_textSegment \
     __ptrauth_restricted_intptr(ptrauth_key_process_dependent_data, 1, \
         ptrauth_string_discriminator("TrampolinePointerWrapper::TrampolinePointers::textSegment"))
 
 #else
 
-#define ptrauth_trampoline_block_page_group
 #define ptrauth_trampoline_textSegment
 
 #endif
@@ -42,8 +42,6 @@ enum {
     OBJC_ASSOCIATION_SYSTEM_OBJECT      = _OBJC_ASSOCIATION_SYSTEM_OBJECT, // 1 << 16
 };
 
-spinlock_t AssociationsManagerLock;
-
 namespace objc {
 
 class ObjcAssociation {
@@ -99,35 +97,227 @@ public:
     }
 };
 
-typedef DenseMap<const void *, ObjcAssociation> ObjectAssociationMap;
+// class ObjectAssociationMap holds one object's associations.
+// Most objects have only one or two, so the first SmallCount are kept in
+// a small array. Adding more moves all of them into a DenseMap. Either
+// one is allocated separately, so that the association table's buckets
+// stay small for objects that have no associations.
+
+class ObjectAssociationMap {
+    using LargeMap = DenseMap<const void *, ObjcAssociation>;
+
+    enum { SmallCount = 2 };
+
+    struct Entry {
+        const void *key;
+        ObjcAssociation association;
+    };
+
+    struct SmallMap {
+        uint32_t count;
+        Entry entries[SmallCount];
+    };
+
+    SmallMap *_small;
+    LargeMap *_large;
+
+    void spill() {
+        ASSERT(!_large);
+        _large = new LargeMap(SmallCount * 2);
+        if (_small) {
+            for (uint32_t i = 0; i < _small->count; i++) {
+                Entry &entry = _small->entries[i];
+                _large->try_emplace(entry.key, std::move(entry.association));
+            }
+            delete _small;
+            _small = nullptr;
+        }
+    }
+
+public:
+    ObjectAssociationMap() : _small(nullptr), _large(nullptr) {}
+    ObjectAssociationMap(const ObjectAssociationMap &) = delete;
+    ObjectAssociationMap &operator=(const ObjectAssociationMap &) = delete;
+    ObjectAssociationMap(ObjectAssociationMap &&other) : ObjectAssociationMap() {
+        swap(other);
+    }
+    ObjectAssociationMap &operator=(ObjectAssociationMap &&other) {
+        swap(other);
+        return *this;
+    }
+    ~ObjectAssociationMap() {
+        delete _small;
+        delete _large;
+    }
+
+    void swap(ObjectAssociationMap &other) {
+        std::swap(_small, other._small);
+        std::swap(_large, other._large);
+    }
+
+    size_t size() const {
+        if (_large) return _large->size();
+        return _small ? _small->count : 0;
+    }
+
+    ObjcAssociation *find(const void *key) {
+        if (slowpath(_large)) {
+            auto it = _large->find(key);
+            return it != _large->end() ? &it->second : nullptr;
+        }
+        if (_small) {
+            for (uint32_t i = 0; i < _small->count; i++) {
+                Entry &entry = _small->entries[i];
+                if (entry.key == key) return &entry.association;
+            }
+        }
+        return nullptr;
+    }
+
+    // Inserts the association if key has none, and returns the
+    // association stored for key and whether it was inserted.
+    // association is left untouched if it was not inserted.
+    std::pair<ObjcAssociation *, bool>
+    try_emplace(const void *key, ObjcAssociation &&association) {
+        if (ObjcAssociation *existing = find(key)) {
+            return {existing, false};
+        }
+        if (!_large) {
+            if (!_small) _small = new SmallMap{};
+            if (_small->count < SmallCount) {
+                Entry &entry = _small->entries[_small->count++];
+                entry.key = key;
+                entry.association = association;
+                association = ObjcAssociation{};
+                return {&entry.association, true};
+            }
+            spill();
+        }
+        auto result = _large->try_emplace(key, std::move(association));
+        return {&result.first->second, true};
+    }
+
+    void erase(const void *key) {
+        if (slowpath(_large)) {
+            _large->erase(key);
+            return;
+        }
+        if (!_small) return;
+        for (uint32_t i = 0; i < _small->count; i++) {
+            if (_small->entries[i].key == key) {
+                uint32_t last = --_small->count;
+                if (i != last) {
+                    _small->entries[i] = _small->entries[last];
+                }
+                _small->entries[last].association = ObjcAssociation{};
+                return;
+            }
+        }
+    }
+
+    // Calls f(key, association) for each association.
+    template<typename F>
+    void forEach(F f) {
+        if (slowpath(_large)) {
+            for (auto &pair : *_large) {
+                f(pair.first, pair.second);
+            }
+            return;
+        }
+        if (_small) {
+            for (uint32_t i = 0; i < _small->count; i++) {
+                f(_small->entries[i].key, _small->entries[i].association);
+            }
+        }
+    }
+};
+
 typedef DenseMap<DisguisedPtr<objc_object>, ObjectAssociationMap> AssociationsHashMap;
 
-// class AssociationsManager manages a lock / hash table singleton pair.
-// Allocating an instance acquires the lock
+// The associations of the objects in one stripe of the address space,
+// and the lock that guards them.
+struct AssociationsTable {
+    spinlock_t slock;
+    AssociationsHashMap map;
+
+    void lock() { slock.lock(); }
+    void unlock() { slock.unlock(); }
+    void reset() { slock.reset(); }
+};
+
+// class AssociationsManager manages the lock / hash table pair
+// for one object. Allocating an instance acquires the lock.
 
 class AssociationsManager {
-    using Storage = ExplicitInitDenseMap<DisguisedPtr<objc_object>, ObjectAssociationMap>;
-    static Storage _mapStorage;
+    using Storage = ExplicitInit<StripedMap<AssociationsTable>>;
+    static Storage _tablesStorage;
+
+    AssociationsTable &_table;
 
 public:
-    AssociationsManager()   { AssociationsManagerLock.lock(); }
-    ~AssociationsManager()  { AssociationsManagerLock.unlock(); }
+    AssociationsManager(const void *object)
+        : _table(tables()[object]) { _table.lock(); }
+    ~AssociationsManager()  { _table.unlock(); }
 
     AssociationsHashMap &get() {
-        return _mapStorage.get();
+        return _table.map;
+    }
+
+    static StripedMap<AssociationsTable> &tables() {
+        return _tablesStorage.get();
     }
 
     static void init() {
-        _mapStorage.init();
+        _tablesStorage.init();
     }
 };
 
-AssociationsManager::Storage AssociationsManager::_mapStorage;
+AssociationsManager::Storage AssociationsManager::_tablesStorage;
 
 } // namespace objc
 
 using namespace objc;
 
+void AssociationsLockAll() {
+    AssociationsManager::tables().lockAll();
+}
+
+void AssociationsUnlockAll() {
+    AssociationsManager::tables().unlockAll();
+}
+
+void AssociationsForceResetAll() {
+    AssociationsManager::tables().forceResetAll();
+}
+
+void AssociationsDefineLockOrder() {
+    AssociationsManager::tables().defineLockOrder();
+}
+
+void AssociationsLocksPrecedeLock(const void *newlock) {
+    AssociationsManager::tables().precedeLock(newlock);
+}
+
+void AssociationsLocksSucceedLock(const void *oldlock) {
+    AssociationsManager::tables().succeedLock(oldlock);
+}
+
+void AssociationsLocksPrecedeSideTableLocks() {
+    int i = 0;
+    const void *lock;
+    while ((lock = AssociationsManager::tables().getLock(i++))) {
+        SideTableLocksSucceedLock(lock);
+    }
+}
+
+void AssociationsLocksSucceedLocks(StripedMap<spinlock_t>& oldlocks) {
+    int i = 0;
+    const void *oldlock;
+    while ((oldlock = oldlocks.getLock(i++))) {
+        AssociationsManager::tables().succeedLock(oldlock);
+    }
+}
+
 void
 _objc_associations_init()
 {
@@ -140,14 +330,13 @@ _object_get_associative_reference(id object, const void *key)
     ObjcAssociation association{};
 
     {
-        AssociationsManager manager;
+        AssociationsManager manager(object);
         AssociationsHashMap &associations(manager.get());
         AssociationsHashMap::iterator i = associations.find((objc_object *)object);
         if (i != associations.end()) {
-            ObjectAssociationMap &refs = i->second;
-            ObjectAssociationMap::iterator j = refs.find(key);
-            if (j != refs.end()) {
-                association = j->second;
+            ObjcAssociation *found = i->second.find(key);
+            if (found) {
+                association = *found;
                 association.retainReturnedValue();
             }
         }
@@ -175,7 +364,7 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
 
     bool isFirstAssociation = false;
     {
-        AssociationsManager manager;
+        AssociationsManager manager(object);
         AssociationsHashMap &associations(manager.get());
 
         if (value) {
@@ -189,16 +378,16 @@ _object_set_associative_reference(id object, const void *key, id value, uintptr_
             auto &refs = refs_result.first->second;
             auto result = refs.try_emplace(key, std::move(association));
             if (!result.second) {
-                association.swap(result.first->second);
+                association.swap(*result.first);
             }
         } else {
             auto refs_it = associations.find(disguised);
             if (refs_it != associations.end()) {
                 auto &refs = refs_it->second;
-                auto it = refs.find(key);
-                if (it != refs.end()) {
-                    association.swap(it->second);
-                    refs.erase(it);
+                ObjcAssociation *found = refs.find(key);
+                if (found) {
+                    association.swap(*found);
+                    refs.erase(key);
                     if (refs.size() == 0) {
                         associations.erase(refs_it);
 
@@ -229,7 +418,7 @@ _object_remove_associations(id object, bool deallocating)
     ObjectAssociationMap refs{};
 
     {
-        AssociationsManager manager;
+        AssociationsManager manager(object);
         AssociationsHashMap &associations(manager.get());
         AssociationsHashMap::iterator i = associations.find((objc_object *)object);
         if (i != associations.end()) {
@@ -238,12 +427,12 @@ _object_remove_associations(id object, bool deallocating)
             // If we are not deallocating, then SYSTEM_OBJECT associations are preserved.
             bool didReInsert = false;
             if (!deallocating) {
-                for (auto &ref: refs) {
-                    if (ref.second.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
-                        i->second.insert(ref);
+                refs.forEach([&](const void *key, ObjcAssociation &ref) {
+                    if (ref.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
+                        i->second.try_emplace(key, ObjcAssociation{ref});
                         didReInsert = true;
                     }
-                }
+                });
             }
             if (!didReInsert)
                 associations.erase(i);
@@ -254,15 +443,15 @@ _object_remove_associations(id object, bool deallocating)
     SmallVector<ObjcAssociation *, 4> laterRefs;
 
     // release everything (outside of the lock).
-    for (auto &i: refs) {
-        if (i.second.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
+    refs.forEach([&](const void *, ObjcAssociation &ref) {
+        if (ref.policy() & OBJC_ASSOCIATION_SYSTEM_OBJECT) {
             // If we are not deallocating, then RELEASE_LATER associations don't get released.
             if (deallocating)
-                laterRefs.append(&i.second);
+                laterRefs.append(&ref);
         } else {
-            i.second.releaseHeldValue();
+            ref.releaseHeldValue();
         }
-    }
+    });
     for (auto *later: laterRefs) {
         later->releaseHeldValue();
     }
@@ -86,8 +86,9 @@
 #define RW_CONSTRUCTING       (1<<26)
 // class allocated and registered
 #define RW_CONSTRUCTED        (1<<25)
-// available for use; was RW_FINALIZE_ON_MAIN_THREAD
-// #define RW_24 (1<<24)
+// class instances are destroyed and freed on the deferred dealloc thread
+// (was RW_FINALIZE_ON_MAIN_THREAD)
+#define RW_DEFERRED_DEALLOC   (1<<24)
 // class +load has been called
 #define RW_LOADED             (1<<23)
 #if !SUPPORT_NONPOINTER_ISA
@@ -100,6 +101,10 @@
 #define RW_FORBIDS_ASSOCIATED_OBJECTS       (1<<20)
 // class has started realizing but not yet completed it
 #define RW_REALIZING          (1<<19)
+// class instances may be released and deallocated on any thread
+#define RW_THREAD_AGNOSTIC_DEALLOC (1<<12)
+// class instance memory is recycled through the instance pools
+#define RW_POOLED_INSTANCES   (1<<11)
 
 #if CONFIG_USE_PREOPT_CACHES
 // this class and its descendants can't have preopt caches with inlined sels
@@ -1085,6 +1090,9 @@ public:
         }
     }
 
+    // The parsed types(). See encoding_getSignature().
+    const struct method_signature_t *signature() const;
+
     const char *types() const {
         switch (getKind()) {
             case Kind::small:
@@ -3041,6 +3049,30 @@ struct objc_class : objc_object {
         return (data()->flags & RW_FORBIDS_ASSOCIATED_OBJECTS);
     }
 
+    bool hasDeferredDeallocation() const {
+        return (data()->flags & RW_DEFERRED_DEALLOC);
+    }
+
+    void setHasDeferredDeallocation() {
+        setInfo(RW_DEFERRED_DEALLOC);
+    }
+
+    bool hasThreadAgnosticDealloc() const {
+        return (data()->flags & RW_THREAD_AGNOSTIC_DEALLOC);
+    }
+
+    void setHasThreadAgnosticDealloc() {
+        setInfo(RW_THREAD_AGNOSTIC_DEALLOC);
+    }
+
+    bool hasPooledInstances() const {
+        return (data()->flags & RW_POOLED_INSTANCES);
+    }
+
+    void setHasPooledInstances() {
+        setInfo(RW_POOLED_INSTANCES);
+    }
+
 #if SUPPORT_NONPOINTER_ISA
     // Tracked in non-pointer isas; not tracked otherwise
 #else
@@ -59,6 +59,9 @@ static method_t *search_method_list(const method_list_t *mlist, SEL sel);
 template<typename T> static bool method_lists_contains_any(T *mlists, T *end,
         SEL sels[], size_t selcount);
 static void flushCaches(Class cls, const char *func, bool (^predicate)(Class c));
+static void invalidateCxxChains(Class cls);
+static void freeCxxChain(Class cls);
+static const cxx_chain_t *getCxxChain_nolock(Class cls);
 static void initializeTaggedPointerObfuscator(void);
 #if SUPPORT_FIXUP
 static void fixupMessageRef(message_ref_t *msg);
@@ -1463,6 +1466,16 @@ prepareMethodLists(Class cls, method_list_t **addedLists, int addedCount,
         }
     }
 
+    // New C++ ctors or dtors change the chains of cls and its subclasses.
+    if (!baseMethods  &&  (cls->hasCxxCtor()  ||  cls->hasCxxDtor())) {
+        SEL cxxSels[] = { SEL_cxx_construct, SEL_cxx_destruct };
+        if (method_lists_contains_any(addedLists, addedLists + addedCount,
+                                      cxxSels, 2))
+        {
+            invalidateCxxChains(cls);
+        }
+    }
+
     // If the class is initialized, then scan for method implementations
     // tracked by the class's flags. If it's not initialized yet,
     // then objc_class::setInitialized() will take care of it.
@@ -2955,6 +2968,17 @@ static Class realizeClassWithoutSwift(Class cls, Class previously)
         rw->flags |= RW_FORBIDS_ASSOCIATED_OBJECTS;
     }
 
+    // Propagate deferred deallocation from the superclass.
+    if (supercls && supercls->hasDeferredDeallocation()) {
+        rw->flags |= RW_DEFERRED_DEALLOC;
+    }
+    if (supercls && supercls->hasThreadAgnosticDealloc()) {
+        rw->flags |= RW_THREAD_AGNOSTIC_DEALLOC;
+    }
+    if (supercls && supercls->hasPooledInstances()) {
+        rw->flags |= RW_POOLED_INSTANCES;
+    }
+
     // Connect this class to its superclass's subclass lists
     if (supercls) {
         addSubclass(supercls, cls);
@@ -4494,6 +4518,13 @@ method_getTypeEncoding(Method mSigned)
 }
 
 
+const method_signature_t *
+method_t::signature() const
+{
+    return encoding_getSignature(types());
+}
+
+
 /***********************************************************************
 * method_setImplementation
 * Sets this method's implementation to imp.
@@ -5919,6 +5950,64 @@ _class_setCustomDeallocInitiation(_Nonnull Class cls)
     }
 }
 
+void
+_class_setDeferredDeallocation(_Nonnull Class cls)
+{
+    if (cls->hasDeferredDeallocation())
+        return;
+
+    {
+        mutex_locker_t guard(runtimeLock);
+
+        foreach_realized_class_and_subclass(cls, [](Class subclass) -> bool {
+            subclass->setHasDeferredDeallocation();
+            return true;
+        });
+    }
+
+    _objc_startDeferredDeallocation();
+}
+
+void
+_class_setThreadAgnosticDealloc(_Nonnull Class cls)
+{
+    if (cls->hasThreadAgnosticDealloc())
+        return;
+
+    mutex_locker_t guard(runtimeLock);
+
+    foreach_realized_class_and_subclass(cls, [](Class subclass) -> bool {
+        subclass->setHasThreadAgnosticDealloc();
+        return true;
+    });
+}
+
+void
+_class_setPooledInstances(_Nonnull Class cls)
+{
+#if _MALLOC_TYPE_ENABLED
+    // A size class's pool is shared by every marked class of that size,
+    // so a stale pointer to a freed instance of one class can end up
+    // pointing at a live instance of another. Typed malloc exists to
+    // rule that out, so it wins. Without it, marking a class accepts
+    // that risk for it and its subclasses. See "Instance pools" in
+    // NSObject.mm.
+    (void)cls;
+#else
+    if (cls->hasPooledInstances())
+        return;
+
+    mutex_locker_t guard(runtimeLock);
+
+    PooledInstancesEnabled.store(true, std::memory_order_relaxed);
+
+    foreach_realized_class_and_subclass(cls, [](Class subclass) -> bool {
+        subclass->setHasPooledInstances();
+        return true;
+    });
+#endif
+}
+
 /***********************************************************************
  * class_copyImpCache
  * Returns the current content of the Class IMP Cache
@@ -7493,6 +7582,214 @@ IMP lookupMethodInClassAndLoadCache(Class cls, SEL sel)
 }
 
 
+/***********************************************************************
+* C++ constructor and destructor chains
+* Constructing an object calls .cxx_construct for each class from the
+* root down to cls that has one. Destroying it calls .cxx_destruct for
+* each class from cls up. Instead of walking the superclasses and looking
+* up the selector at every level for every object, each class with C++
+* ivars gets a flat cxx_chain_t of the IMPs to call. It is built when the
+* class is initialized, or on first use if that comes earlier.
+*
+* Chains are found through cxxChainTable, an open-addressed table keyed
+* by class. Readers search it without locking. It is only written with
+* runtimeLock held. A full table is replaced by one twice its size, and
+* the old table is not freed because readers may still be searching it.
+* The old tables together are smaller than the current one.
+*
+* Changing a .cxx_construct or .cxx_destruct method, adding one to a
+* class with C++ ivars, or changing a class's superclass drops the
+* chains of the affected classes. They are rebuilt on next use. Dropped
+* chains are not freed either. Such changes essentially never happen.
+**********************************************************************/
+struct cxx_chain_bucket_t {
+    explicit_atomic<Class> cls;
+    explicit_atomic<cxx_chain_t *> chain;
+};
+
+struct cxx_chain_table_t {
+    uintptr_t mask;
+    uintptr_t occupied;
+    cxx_chain_bucket_t buckets[0];
+};
+
+#define CXX_CHAIN_TABLE_INITIAL_CAPACITY 64
+
+static explicit_atomic<cxx_chain_table_t *> cxxChainTable{nil};
+
+static cxx_chain_bucket_t *
+findCxxChainBucket(cxx_chain_table_t *table, Class cls)
+{
+    uintptr_t index = ptr_hash((uintptr_t)cls) & table->mask;
+    while (Class c = table->buckets[index].cls.load(std::memory_order_acquire)) {
+        if (c == cls) return &table->buckets[index];
+        index = (index + 1) & table->mask;
+    }
+    return &table->buckets[index];
+}
+
+static cxx_chain_table_t *
+growCxxChainTable(cxx_chain_table_t *oldTable)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    uintptr_t capacity = oldTable ? (oldTable->mask + 1) * 2
+                                  : CXX_CHAIN_TABLE_INITIAL_CAPACITY;
+    auto table = (cxx_chain_table_t *)
+        calloc(1, sizeof(cxx_chain_table_t) + capacity * sizeof(cxx_chain_bucket_t));
+    table->mask = capacity - 1;
+
+    // Keep only classes that still have a chain.
+    if (oldTable) {
+        for (uintptr_t i = 0; i <= oldTable->mask; i++) {
+            auto &old = oldTable->buckets[i];
+            cxx_chain_t *chain = old.chain.load(std::memory_order_relaxed);
+            if (!chain) continue;
+            auto bucket = findCxxChainBucket(table, old.cls.load(std::memory_order_relaxed));
+            bucket->chain.store(chain, std::memory_order_relaxed);
+            bucket->cls.store(old.cls.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->occupied++;
+        }
+    }
+
+    cxxChainTable.store(table, std::memory_order_release);
+    return table;
+}
+
+static cxx_chain_t *buildCxxChain(Class cls)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    uint32_t maxConstruct = 0;
+    uint32_t maxDestruct = 0;
+    for (Class c = cls; c  &&  c->hasCxxCtor(); c = c->getSuperclass()) {
+        maxConstruct++;
+    }
+    for (Class c = cls; c  &&  c->hasCxxDtor(); c = c->getSuperclass()) {
+        maxDestruct++;
+    }
+
+    auto chain = (cxx_chain_t *)
+        calloc(1, sizeof(cxx_chain_t) +
+               (maxConstruct + maxDestruct) * sizeof(cxx_chain_t::entry_t));
+
+    // Constructors run root class first, so fill them in backwards
+    // and then slide them down over the classes that had none.
+    uint32_t first = maxConstruct;
+    for (Class c = cls; c  &&  c->hasCxxCtor(); c = c->getSuperclass()) {
+        if (method_t *meth = getMethodNoSuper_nolock(c, SEL_cxx_construct)) {
+            chain->entries[--first] = { c, meth->imp(false) };
+        }
+    }
+    chain->constructCount = maxConstruct - first;
+    memmove(chain->entries, chain->entries + first,
+            chain->constructCount * sizeof(cxx_chain_t::entry_t));
+
+    auto destructors = chain->entries + chain->constructCount;
+    for (Class c = cls; c  &&  c->hasCxxDtor(); c = c->getSuperclass()) {
+        if (method_t *meth = getMethodNoSuper_nolock(c, SEL_cxx_destruct)) {
+            destructors[chain->destructCount++] = { c, meth->imp(false) };
+        }
+    }
+
+    return chain;
+}
+
+static const cxx_chain_t *getCxxChain_nolock(Class cls)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    cxx_chain_table_t *table = cxxChainTable.load(std::memory_order_relaxed);
+    if (table) {
+        auto bucket = findCxxChainBucket(table, cls);
+        if (auto chain = bucket->chain.load(std::memory_order_relaxed)) {
+            return chain;
+        }
+    }
+
+    if (!table  ||  (table->occupied + 1) * 4 > (table->mask + 1) * 3) {
+        table = growCxxChainTable(table);
+    }
+
+    // Publish the chain before the class so readers
+    // that find the class also find its chain.
+    cxx_chain_t *chain = buildCxxChain(cls);
+    auto bucket = findCxxChainBucket(table, cls);
+    bucket->chain.store(chain, std::memory_order_release);
+    if (!bucket->cls.load(std::memory_order_relaxed)) {
+        bucket->cls.store(cls, std::memory_order_release);
+        table->occupied++;
+    }
+    return chain;
+}
+
+/***********************************************************************
+* getCxxChain
+* Returns the C++ ctors and dtors to call for instances of cls.
+* Locking: none on the fast path. Acquires runtimeLock to build a chain.
+*   The caller must not hold runtimeLock.
+**********************************************************************/
+const cxx_chain_t *getCxxChain(Class cls)
+{
+    cxx_chain_table_t *table = cxxChainTable.load(std::memory_order_acquire);
+    if (fastpath(table)) {
+        auto bucket = findCxxChainBucket(table, cls);
+        if (auto chain = bucket->chain.load(std::memory_order_acquire)) {
+            return chain;
+        }
+    }
+
+    mutex_locker_t lock(runtimeLock);
+    return getCxxChain_nolock(cls);
+}
+
+/***********************************************************************
+* invalidateCxxChains
+* Drops the chains of cls and its subclasses, or of every class if
+* cls is nil.
+* Locking: runtimeLock must be held by the caller
+**********************************************************************/
+static void invalidateCxxChains(Class cls)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    cxx_chain_table_t *table = cxxChainTable.load(std::memory_order_relaxed);
+    if (!table) return;
+
+    if (!cls) {
+        for (uintptr_t i = 0; i <= table->mask; i++) {
+            table->buckets[i].chain.store(nil, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    foreach_realized_class_and_subclass(cls, ^(Class c){
+        findCxxChainBucket(table, c)->chain.store(nil, std::memory_order_relaxed);
+        return true;
+    });
+}
+
+/***********************************************************************
+* freeCxxChain
+* Frees the chain of a class that is being disposed of.
+* Nothing can be constructing or destroying instances of it.
+* Locking: runtimeLock must be held by the caller
+**********************************************************************/
+static void freeCxxChain(Class cls)
+{
+    lockdebug::assert_locked(&runtimeLock);
+
+    cxx_chain_table_t *table = cxxChainTable.load(std::memory_order_relaxed);
+    if (!table) return;
+
+    auto bucket = findCxxChainBucket(table, cls);
+    if (auto chain = bucket->chain.load(std::memory_order_relaxed)) {
+        bucket->chain.store(nil, std::memory_order_relaxed);
+        free(chain);
+    }
+}
+
+
 /***********************************************************************
 * class_getProperty
 * fixme
@@ -7564,6 +7861,10 @@ objc_class::setInitialized()
 
     objc::Scanner::scanInitializedClass(cls, metacls);
 
+    if (cls->hasCxxCtor()  ||  cls->hasCxxDtor()) {
+        getCxxChain_nolock(cls);
+    }
+
 #if CONFIG_USE_PREOPT_CACHES
     cls->cache.maybeConvertToPreoptimized();
     metacls->cache.maybeConvertToPreoptimized();
@@ -7760,6 +8061,10 @@ static void
 adjustCustomFlagsForMethodChange(Class cls, method_t *meth)
 {
     objc::Scanner::scanChangedMethod(cls, meth);
+
+    if (meth->name() == SEL_cxx_construct  ||  meth->name() == SEL_cxx_destruct) {
+        invalidateCxxChains(cls);
+    }
 }
 
 
@@ -8505,7 +8810,8 @@ static void objc_initializeClassPair_internal(Class superclass, const char *name
     meta_rw_w->set_ro(meta_ro_w);
 
     if (superclass) {
-        uint32_t flagsToCopy = RW_FORBIDS_ASSOCIATED_OBJECTS;
+        uint32_t flagsToCopy = RW_FORBIDS_ASSOCIATED_OBJECTS | RW_DEFERRED_DEALLOC |
+            RW_THREAD_AGNOSTIC_DEALLOC | RW_POOLED_INSTANCES;
         cls_rw_w->flags |= superclass->data()->flags & flagsToCopy;
         cls_ro_w->instanceStart = superclass->unalignedInstanceSize();
         meta_ro_w->instanceStart = superclass->ISA()->unalignedInstanceSize();
@@ -8760,6 +9066,7 @@ static void detach_class(Class cls, bool isMeta)
     // class tables and +load queue
     if (!isMeta) {
         removeNamedClass(cls, cls->mangledName());
+        freeCxxChain(cls);
     }
     objc::allocatedClasses.get().erase(cls);
 }
@@ -8926,7 +9233,14 @@ _class_createInstance(Class cls, size_t extraBytes,
     size = cls->instanceSize(extraBytes);
     if (outAllocatedSize) *outAllocatedSize = size;
 
-    id obj = objc::malloc_instance(size, cls);
+    id obj;
+    if (slowpath(PooledInstancesEnabled.load(std::memory_order_relaxed))  &&
+        cls->hasPooledInstances()  &&  extraBytes == 0)
+    {
+        obj = _objc_allocPooledInstance(cls, size);
+    } else {
+        obj = objc::malloc_instance(size, cls);
+    }
     if (slowpath(!obj)) {
         if (construct_flags & OBJECT_CONSTRUCT_CALL_BADALLOC) {
             return _objc_callBadAllocHandler(cls);
@@ -8967,12 +9281,9 @@ _objc_rootAllocWithZone(Class cls, objc_zone_t)
 
 /***********************************************************************
 * class_createInstances
-* fixme
+* Batch-allocating version of class_createInstance.
 * Locking: none
 **********************************************************************/
-#if SUPPORT_NONPOINTER_ISA
-#warning fixme optimize class_createInstances
-#endif
 unsigned
 class_createInstances(Class cls, size_t extraBytes,
                       id *results, unsigned num_requested)
@@ -9073,8 +9384,18 @@ object_dispose(id obj)
 {
     if (!obj) return nil;
 
+    if (slowpath(DeferredDeallocationStarted.load(std::memory_order_relaxed)) && _object_deferDispose(obj))
+        return nil;
+
+    Class cls = obj->ISA();
     objc_destructInstance(obj);
-    free(obj);
+    if (slowpath(PooledInstancesEnabled.load(std::memory_order_relaxed))  &&
+        cls->hasPooledInstances())
+    {
+        _objc_freePooledInstance(obj, cls);
+    } else {
+        free(obj);
+    }
 
     return nil;
 }
@@ -9469,6 +9790,7 @@ static Class setSuperclass(Class cls, Class newSuper)
     // Flush subclass's method caches.
     flushCaches(cls, __func__, [](Class c){ return true; });
     flushCaches(cls->ISA(), __func__, [](Class c){ return true; });
+    invalidateCxxChains(cls);
 
     return oldSuper;
 }
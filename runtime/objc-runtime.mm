@@ -49,6 +49,7 @@
 #include "llvm-MathExtras.h"
 #include "objc-private.h"
 #include "objc-loadmethod.h"
+#include "objc-weak.h"
 #include "objc-file.h"
 #include "message.h"
 
@@ -102,6 +103,11 @@ const option_t Settings[] = {
 
 namespace objc {
     int PageCountWarning = 50;  // Default value if the environment variable is not set
+    int PoolSparePageLimit = 0;  // Default value if the environment variable is not set
+    int CoalescingLRUDepth = 4;  // Default value if the environment variable is not set
+    int PoolSampleInterval = 0;  // Default value if the environment variable is not set
+    int PoolBackgroundReleaseThreshold = 0;  // Default value if the environment variable is not set
+    const char *LoadProfilePath = nil;  // Default value if the environment variable is not set
 }
 
 // objc's TLS
@@ -368,6 +374,73 @@ void SetPageCountWarning(const char* envvar) {
     }
 }
 
+/***********************************************************************
+* SetPoolSparePageLimit
+* Convert environment variable value to integer value.
+* If the value is valid, set the global PoolSparePageLimit value.
+**********************************************************************/
+void SetPoolSparePageLimit(const char* envvar) {
+    if (envvar) {
+        long result = strtol(envvar, NULL, 10);
+        if (result <= 1024 && result >= 0) {
+            objc::PoolSparePageLimit = (int)result;
+        }
+    }
+}
+
+/***********************************************************************
+* SetCoalescingLRUDepth
+* Convert environment variable value to integer value.
+* If the value is valid, set the global CoalescingLRUDepth value.
+**********************************************************************/
+void SetCoalescingLRUDepth(const char* envvar) {
+    if (envvar) {
+        long result = strtol(envvar, NULL, 10);
+        if (result <= 256 && result >= 1) {
+            objc::CoalescingLRUDepth = (int)result;
+        }
+    }
+}
+
+/***********************************************************************
+* SetPoolSampleInterval
+* Convert environment variable value to integer value.
+* If the value is valid, set the global PoolSampleInterval value.
+**********************************************************************/
+void SetPoolSampleInterval(const char* envvar) {
+    if (envvar) {
+        long result = strtol(envvar, NULL, 10);
+        if (result <= INT_MAX && result >= 0) {
+            objc::PoolSampleInterval = (int)result;
+        }
+    }
+}
+
+/***********************************************************************
+* SetPoolBackgroundReleaseThreshold
+* Convert environment variable value to integer value.
+* If the value is valid, set the global PoolBackgroundReleaseThreshold value.
+**********************************************************************/
+void SetPoolBackgroundReleaseThreshold(const char* envvar) {
+    if (envvar) {
+        long result = strtol(envvar, NULL, 10);
+        if (result <= INT_MAX && result >= 0) {
+            objc::PoolBackgroundReleaseThreshold = (int)result;
+        }
+    }
+}
+
+/***********************************************************************
+* SetLoadProfilePath
+* Copy the environment variable value.
+* If the value is not empty, set the global LoadProfilePath value.
+**********************************************************************/
+void SetLoadProfilePath(const char* envvar) {
+    if (envvar  &&  envvar[0]) {
+        objc::LoadProfilePath = strdup(envvar);
+    }
+}
+
 //{
 //    const uint32_t proc_sdk_ver = proc_sdk(current_proc());
 //    
@@ -496,6 +569,26 @@ void environ_init(void)
             SetPageCountWarning(*p + 22);
             continue;
         }
+        if (0 == strncmp(*p, "OBJC_POOL_SPARE_PAGES=", 22)) {
+            SetPoolSparePageLimit(*p + 22);
+            continue;
+        }
+        if (0 == strncmp(*p, "OBJC_AUTORELEASE_COALESCING_LRU_DEPTH=", 38)) {
+            SetCoalescingLRUDepth(*p + 38);
+            continue;
+        }
+        if (0 == strncmp(*p, "OBJC_SAMPLE_POOL_SITES=", 23)) {
+            SetPoolSampleInterval(*p + 23);
+            continue;
+        }
+        if (0 == strncmp(*p, "OBJC_BACKGROUND_POOL_RELEASE_THRESHOLD=", 39)) {
+            SetPoolBackgroundReleaseThreshold(*p + 39);
+            continue;
+        }
+        if (0 == strncmp(*p, "OBJC_PROFILE_LOAD_METHODS_FILE=", 31)) {
+            SetLoadProfilePath(*p + 31);
+            continue;
+        }
 
         const char *value = strchr(*p, '=');
         if (!*value) continue;
@@ -645,6 +738,9 @@ _objc_pthread_data::~_objc_pthread_data() {
         }
     }
     free(classNameLookups);
+    weak_hazard_destroy(weakHazard);
+    free(poolSamples);
+    _objc_instancePoolDestroy(instancePool);
 
     // add further cleanup here...
 }
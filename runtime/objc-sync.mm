@@ -25,17 +25,42 @@
 #include "objc-sync.h"
 
 //
-// Allocate a lock only when needed.  Since few locks are needed at any point
-// in time, keep them on a single list.
+// Allocate a lock only when needed. Locks are kept in small per-stripe hash
+// tables and reclaimed once no thread is using them.
 //
 
 
 typedef struct alignas(CacheLineSize) SyncData {
-    struct SyncData* nextData;
+    struct SyncData* nextData;  // next spare entry, see SyncList::reclaim
     DisguisedPtr<objc_object> object;
     SyncKind kind;
     int32_t threadCount;  // number of THREADS using this block
     recursive_mutex_t mutex;
+    // Shared holders hold rwlock for reading without taking the mutex.
+    // Once object has been locked shared, an exclusive holder holds the
+    // mutex and rwlock for writing; until then it holds only the mutex.
+    // writers is the recursion depth of the exclusive lock and writer is
+    // its owner. Both are changed only by the thread holding the mutex.
+    // See lockExclusive and lockShared.
+    objc_rwlock_t rwlock;
+    std::atomic<int32_t> writers;
+    std::atomic<objc_thread_t> writer;
+    // Set, with the mutex held, before object is first locked shared.
+    // Cleared when the entry is reused for another object.
+    std::atomic<bool> sharedUsed;
+    // Contention profile, kept when OBJC_PROFILE_SYNC_CONTENTION is set.
+    // cls is the class of the object at the first contended acquisition.
+    std::atomic<uint64_t> acquisitions;
+    std::atomic<uint64_t> contendedAcquisitions;
+    std::atomic<uint64_t> waitNanoseconds;
+    std::atomic<Class> cls;
+
+    void resetProfile() {
+        acquisitions.store(0, std::memory_order_relaxed);
+        contendedAcquisitions.store(0, std::memory_order_relaxed);
+        waitNanoseconds.store(0, std::memory_order_relaxed);
+        cls.store(nil, std::memory_order_relaxed);
+    }
 
     bool matches(id matchObject, SyncKind matchKind) {
         ASSERT(matchKind != SyncKind::invalid);
@@ -75,11 +100,312 @@ static tls_direct_fast(SyncData *, tls_key::sync_data) syncData;
 static tls_direct_fast(uintptr_t, tls_key::sync_count) syncLockCount;
 #endif
 
+/*
+  Thin locks: an uncontended @synchronized takes no SyncData and no mutex.
+  The lock word is a slot in thinLocks chosen by hashing the object. A
+  thread locks an object thin by swapping the slot's owner word from zero
+  to the object, and records that in its fast cache in place of a
+  SyncData, tagged with ThinTag. syncLockCount is the recursion count.
+
+  The thread holding a slot's owner word also holds the slot's lock, a
+  plain unfair lock. A thread that finds the object locked thin by another
+  thread locks it through id2data instead. A SyncData entry in use inflates
+  its object's slot: the slot's inflated count is raised when the entry's
+  threadCount rises from zero, and dropped when it falls back to zero. No
+  object hashing to an inflated slot is locked thin. A thread that takes
+  an entry then blocks on the slot's lock until no thread holds the object
+  thin, which lends the owner the waiter's priority. So the thin and fat
+  paths never hold the same object at once, and the slot goes back to thin
+  locking when no entry of its objects is in use.
+
+  Only SyncKind::atSynchronize on non-tagged objects uses thin locks.
+  _objc_sync_foreach_lock does not report locks held thin.
+ */
+
+#if ENABLE_FAST_CACHE
+#define ENABLE_THIN_LOCKS 1
+#else
+#define ENABLE_THIN_LOCKS 0
+#endif
+
+#if ENABLE_THIN_LOCKS
+struct alignas(CacheLineSize) ThinLock {
+    objc_nodebug_lock_t lock;        // held while owner is set
+    std::atomic<uintptr_t> owner;    // object locked thin, or zero
+    std::atomic<uintptr_t> inflated; // entries in use for objects in this slot
+};
+
+#define THIN_LOCK_COUNT 256
+static ThinLock thinLocks[THIN_LOCK_COUNT];
+
+static constexpr uintptr_t ThinTag = 1;
+
+static ThinLock &thinLockFor(id obj)
+{
+    return thinLocks[ptr_hash((uintptr_t)obj) & (THIN_LOCK_COUNT - 1)];
+}
+
+static SyncData *thinEntry(id obj)
+{
+    return (SyncData *)((uintptr_t)obj | ThinTag);
+}
+
+static bool isThinEntry(SyncData *data)
+{
+    return (uintptr_t)data & ThinTag;
+}
+
+// Thin locks are off while contention is profiled, so that every
+// acquisition is counted.
+static bool usesThinLock(id obj, SyncKind kind)
+{
+    return kind == SyncKind::atSynchronize  &&
+        !obj->isTaggedPointer()  &&  !DisableThinSyncLocks  &&
+        !ProfileSyncContention;
+}
+
+// Locks obj thin, or adds a recursive lock if this thread already holds
+// it thin. Returns false if obj must be locked fat.
+static bool thinEnter(id obj)
+{
+    SyncData *cached = syncData;
+    if (cached == thinEntry(obj)) {
+        syncLockCount++;
+        return true;
+    }
+    // The fast cache holds another lock. Don't bother.
+    if (cached) return false;
+
+    ThinLock &thin = thinLockFor(obj);
+    if (thin.inflated.load(std::memory_order_relaxed) != 0) return false;
+
+    if (!thin.lock.tryLock()) return false;
+    thin.owner.store((uintptr_t)obj);
+    // An inflater raises the count before reading owner, and we set owner
+    // before reading the count, so at least one of us sees the other.
+    if (thin.inflated.load() != 0) {
+        thin.owner.store(0, std::memory_order_release);
+        thin.lock.unlock();
+        return false;
+    }
+
+    syncData = thinEntry(obj);
+    syncLockCount = 1;
+    return true;
+}
+
+// Releases one thin lock of obj. Returns false if this thread doesn't
+// hold obj thin.
+static bool thinExit(id obj)
+{
+    if (syncData != thinEntry(obj)) return false;
+
+    if (--syncLockCount == 0) {
+        syncData = nullptr;
+        ThinLock &thin = thinLockFor(obj);
+        thin.owner.store(0, std::memory_order_release);
+        thin.lock.unlock();
+    }
+    return true;
+}
+
+// Keeps obj from being locked thin until the matching deflate().
+static void inflate(id obj)
+{
+    thinLockFor(obj).inflated.fetch_add(1);
+}
+
+static void deflate(id obj)
+{
+    thinLockFor(obj).inflated.fetch_sub(1, std::memory_order_release);
+}
+
+// True if a thread holds obj thin. The caller holds a threadCount on
+// obj's entry, so obj's slot is inflated: an inflater raises the count
+// before reading owner, and thinEnter sets owner before reading the
+// count, so at least one of them sees the other.
+static bool isLockedThin(id obj)
+{
+    return thinLockFor(obj).owner.load() == (uintptr_t)obj;
+}
+
+// Waits until no thread holds obj thin. The caller holds a threadCount
+// on obj's entry, so obj can't be locked thin again afterwards.
+static void waitForThinOwner(id obj)
+{
+    ThinLock &thin = thinLockFor(obj);
+    while (isLockedThin(obj)) {
+        // The owner holds the slot's lock until it unlocks obj. This
+        // thread can't be holding it: it would have found obj in its
+        // own fast cache.
+        thin.lock.lock();
+        thin.lock.unlock();
+    }
+}
+#endif // ENABLE_THIN_LOCKS
+
+// Inflates the thin lock slot of data's object. Called when data's
+// threadCount rises from zero, with the stripe lock held.
+static void inflateEntry(SyncData *data)
+{
+#if ENABLE_THIN_LOCKS
+    id obj = (id)(objc_object *)data->object;
+    if (usesThinLock(obj, data->kind)) inflate(obj);
+#endif
+}
+
+// Open-addressed table of SyncData, probed linearly from hash().
+// Entries stay in the table while idle (threadCount == 0) so that the next
+// acquisition of the same object finds them again. An idle entry on the
+// probe path is reused in place for a new object. The remaining idle
+// entries are reclaimed when the table fills up and is rebuilt, so the
+// table is sized by the number of locks in use, not by the number of
+// objects ever synchronized on.
+//
+// A thread may only touch a SyncData while it holds a threadCount on it.
+// threadCount is raised with the stripe lock held and dropped without it,
+// after the thread's last unlock of the mutex (see dropThread), so an
+// entry seen idle with the stripe lock held can be reused or freed.
 struct SyncList {
-    SyncData *_data;
+    SyncData **_table;
+    uint32_t _capacity;   // power of two, or zero before the first lock
+    uint32_t _count;      // occupied slots
+    SyncData *_spares;    // reclaimed entries kept for reuse
+    uint32_t _spareCount;
+    uint64_t _reclaimed;
     spinlock_t _lock;
 
-    SyncList() : _data(nil), _lock(fork_unsafe) { }
+    enum { MinCapacity = 8, MaxSpares = 8 };
+
+    SyncList()
+        : _table(nil), _capacity(0), _count(0), _spares(nil),
+          _spareCount(0), _reclaimed(0), _lock(fork_unsafe) { }
+
+    static uint32_t hash(id object, SyncKind kind) {
+        return ptr_hash((uintptr_t)object ^ (uintptr_t)kind);
+    }
+
+    static bool isIdle(SyncData *data) {
+        // Pairs with the decrement in dropThread.
+        return reinterpret_cast<std::atomic<int32_t> *>(&data->threadCount)
+            ->load(std::memory_order_acquire) == 0;
+    }
+
+    // Idle entries may be reused or reclaimed, except that contended ones
+    // are kept for the report while contention is being profiled.
+    static bool isReclaimable(SyncData *data) {
+        if (!isIdle(data)) return false;
+        return !ProfileSyncContention  ||
+            data->contendedAcquisitions.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Returns the entry for object and kind, or nil. If idle is not nil,
+    // it is set to the first idle entry on the probe path, if there is one.
+    SyncData *find(id object, SyncKind kind, SyncData **idle) {
+        if (!_table) return nil;
+        uint32_t mask = _capacity - 1;
+        for (uint32_t i = hash(object, kind) & mask;
+             _table[i];
+             i = (i + 1) & mask)
+        {
+            SyncData *data = _table[i];
+            if (data->matches(object, kind)) return data;
+            if (idle  &&  !*idle  &&  isReclaimable(data)) *idle = data;
+        }
+        return nil;
+    }
+
+    void insert(SyncData *data) {
+        uint32_t mask = _capacity - 1;
+        uint32_t i = hash((id)(objc_object *)data->object, data->kind) & mask;
+        while (_table[i]) i = (i + 1) & mask;
+        _table[i] = data;
+        _count++;
+    }
+
+    SyncData *allocate() {
+        SyncData *data = _spares;
+        if (data) {
+            _spares = data->nextData;
+            _spareCount--;
+            return data;
+        }
+
+        // XXX allocating memory with a spinlock held is bad practice, but
+        // the spares and idle reuse keep us out of malloc most of the time.
+        posix_memalign((void **)&data, alignof(SyncData), sizeof(SyncData));
+        new (&data->mutex) recursive_mutex_t(fork_unsafe);
+        new (&data->rwlock) objc_rwlock_t;
+        data->writers.store(0, std::memory_order_relaxed);
+        data->writer.store(objc_thread_t{}, std::memory_order_relaxed);
+        return data;
+    }
+
+    void reclaim(SyncData *data) {
+        _reclaimed++;
+        if (_spareCount < MaxSpares) {
+            data->nextData = _spares;
+            _spares = data;
+            _spareCount++;
+        } else {
+            data->mutex.~recursive_mutex_t();
+            data->rwlock.~objc_rwlock_t();
+            free(data);
+        }
+    }
+
+    // Reclaims every idle entry and resizes the table to hold the
+    // remaining ones at no more than half load.
+    void rebuild() {
+        SyncData **oldTable = _table;
+        uint32_t oldCapacity = _capacity;
+        uint32_t live = 0;
+
+        for (uint32_t i = 0; i < oldCapacity; i++) {
+            SyncData *data = oldTable[i];
+            if (!data) continue;
+            if (isReclaimable(data)) {
+                reclaim(data);
+                oldTable[i] = nil;
+            } else {
+                live++;
+            }
+        }
+
+        uint32_t capacity = MinCapacity;
+        while (capacity < live * 2 + 2) capacity *= 2;
+
+        _table = (SyncData **)calloc(capacity, sizeof(SyncData *));
+        _capacity = capacity;
+        _count = 0;
+        for (uint32_t i = 0; i < oldCapacity; i++) {
+            if (oldTable[i]) insert(oldTable[i]);
+        }
+        free(oldTable);
+    }
+
+    // Adds a new entry for object and kind, held by the calling thread.
+    SyncData *add(id object, SyncKind kind) {
+        // Keep the load at or below 3/4 so probe sequences stay short.
+        if ((_count + 1) * 4 > _capacity * 3) rebuild();
+
+        SyncData *data = allocate();
+        data->object = (objc_object *)object;
+        data->kind = kind;
+        data->threadCount = 1;
+        data->sharedUsed.store(false, std::memory_order_relaxed);
+        data->resetProfile();
+        insert(data);
+        inflateEntry(data);
+        return data;
+    }
+
+    template <typename F>
+    void forEach(F f) {
+        for (uint32_t i = 0; i < _capacity; i++) {
+            if (_table[i]) f(_table[i]);
+        }
+    }
 
     void lock() {
         _lock.lock();
@@ -94,9 +420,9 @@ struct SyncList {
     }
 };
 
-// Use multiple parallel lists to decrease contention among unrelated objects.
+// Use multiple parallel tables to decrease contention among unrelated objects.
 #define LOCK_FOR_OBJ(obj) sDataLists[obj]._lock
-#define LIST_FOR_OBJ(obj) sDataLists[obj]._data
+#define LIST_FOR_OBJ(obj) sDataLists[obj]
 static StripedMap<SyncList> sDataLists;
 
 
@@ -151,11 +477,35 @@ static void clearSyncCache()
 #endif
 }
 
-static SyncData* id2data(id object, SyncKind kind, enum usage why)
+// Drops the calling thread's use of data after its last RELEASE.
+// The entry may be reused or freed by another thread as soon as its
+// threadCount reaches zero, so this must come after the mutex is unlocked
+// and must be the thread's last access to data.
+static void dropThread(SyncData *data)
+{
+#if ENABLE_THIN_LOCKS
+    id obj = (id)(objc_object *)data->object;
+    bool thin = usesThinLock(obj, data->kind);
+#endif
+    // atomic because may collide with concurrent ACQUIRE
+    int32_t oldCount = AtomicDecrement(&data->threadCount);
+#if ENABLE_THIN_LOCKS
+    if (oldCount == 1  &&  thin) deflate(obj);
+#else
+    (void)oldCount;
+#endif
+}
+
+// If firstOrLast is not nil, it is set to true when an ACQUIRE is the
+// thread's first lock of the returned data, or a RELEASE is its last.
+// After the last RELEASE the caller must call dropThread.
+static SyncData* id2data(id object, SyncKind kind, enum usage why,
+                         bool *firstOrLast = nullptr)
 {
     ASSERT(kind != SyncKind::invalid);
+    ASSERT(why != RELEASE  ||  firstOrLast);
     spinlock_t *lockp = &LOCK_FOR_OBJ(object);
-    SyncData **listp = &LIST_FOR_OBJ(object);
+    SyncList *listp = &LIST_FOR_OBJ(object);
     SyncData* result = NULL;
 
 #if ENABLE_FAST_CACHE
@@ -165,7 +515,7 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
     if (data) {
         fastCacheOccupied = YES;
 
-        if (data->matches(object, kind)) {
+        if (!isThinEntry(data)  &&  data->matches(object, kind)) {
             // Found a match in fast cache.
             result = data;
             if (result->threadCount <= 0  ||  syncLockCount <= 0) {
@@ -181,8 +531,7 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
                 if (--syncLockCount == 0) {
                     // remove from fast cache
                     syncData = nullptr;
-                    // atomic because may collide with concurrent ACQUIRE
-                    AtomicDecrement(&result->threadCount);
+                    *firstOrLast = true;
                 }
                 break;
             case CHECK:
@@ -218,8 +567,7 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
                 if (item->lockCount == 0) {
                     // remove from per-thread cache
                     cache->list[i] = cache->list[--cache->used];
-                    // atomic because may collide with concurrent ACQUIRE
-                    AtomicDecrement(&result->threadCount);
+                    *firstOrLast = true;
                 }
                 break;
             case CHECK:
@@ -232,53 +580,45 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
     }
 
     // Thread cache didn't find anything.
-    // Walk in-use list looking for matching object
+    // Look up the object in the stripe's table.
     // Spinlock prevents multiple threads from creating multiple 
     // locks for the same new object.
-    // We could keep the nodes in some hash table if we find that there are
-    // more than 20 or so distinct locks active, but we don't do that now.
     
     lockp->lock();
 
     {
-        SyncData* p;
         SyncData* firstUnused = NULL;
-        for (p = *listp; p != NULL; p = p->nextData) {
-            if ( p->matches(object, kind) ) {
-                result = p;
+        result = listp->find(object, kind,
+                             why == ACQUIRE ? &firstUnused : nullptr);
+        if (result) {
+            if (why == ACQUIRE) {
                 // atomic because may collide with concurrent RELEASE
-                AtomicIncrement(&result->threadCount);
-                goto done;
+                if (AtomicIncrement(&result->threadCount) == 0) {
+                    inflateEntry(result);
+                }
             }
-            if ( (firstUnused == NULL) && (p->threadCount == 0) )
-                firstUnused = p;
+            goto done;
         }
     
         // no SyncData currently associated with object
         if ( (why == RELEASE) || (why == CHECK) )
             goto done;
     
-        // an unused one was found, use it
+        // an unused one was found on the probe path, use it
         if ( firstUnused != NULL ) {
             result = firstUnused;
             result->object = (objc_object *)object;
             result->kind = kind;
             result->threadCount = 1;
+            result->sharedUsed.store(false, std::memory_order_relaxed);
+            result->resetProfile();
+            inflateEntry(result);
             goto done;
         }
     }
 
-    // Allocate a new SyncData and add to list.
-    // XXX allocating memory with a global lock held is bad practice,
-    // might be worth releasing the lock, allocating, and searching again.
-    // But since we never free these guys we won't be stuck in allocation very often.
-    posix_memalign((void **)&result, alignof(SyncData), sizeof(SyncData));
-    result->object = (objc_object *)object;
-    result->kind = kind;
-    result->threadCount = 1;
-    new (&result->mutex) recursive_mutex_t(fork_unsafe);
-    result->nextData = *listp;
-    *listp = result;
+    // Allocate a new SyncData and add it to the table.
+    result = listp->add(object, kind);
     
  done:
     lockp->unlock();
@@ -293,6 +633,7 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
         }
         if (why != ACQUIRE) _objc_fatal("id2data is buggy");
         if (!result->matches(object, kind)) _objc_fatal("id2data is buggy");
+        if (firstOrLast) *firstOrLast = true;
 
 #if ENABLE_FAST_CACHE
         if (!fastCacheOccupied) {
@@ -314,6 +655,190 @@ static SyncData* id2data(id object, SyncKind kind, enum usage why)
 }
 
 
+// Returns the entry for object that this thread holds, and sets
+// *lockCount to the number of locks it holds on it, exclusive and
+// shared. Returns nil if this thread holds none. Checks only the
+// per-thread caches, where id2data(RELEASE) finds held entries.
+static SyncData *heldData(id object, SyncKind kind, unsigned *lockCount)
+{
+#if ENABLE_FAST_CACHE
+    SyncData *data = syncData;
+    if (data  &&  !isThinEntry(data)  &&  data->matches(object, kind)) {
+        *lockCount = (unsigned)syncLockCount;
+        return data;
+    }
+#endif
+    SyncCache *cache = fetch_cache(NO);
+    if (cache) {
+        for (unsigned i = 0; i < cache->used; i++) {
+            SyncCacheItem *item = &cache->list[i];
+            if (item->data->matches(object, kind)) {
+                *lockCount = item->lockCount;
+                return item->data;
+            }
+        }
+    }
+    return nil;
+}
+
+// The number of data's locks held by this thread that are exclusive.
+// The rest of lockCount are shared.
+static unsigned exclusiveCount(SyncData *data)
+{
+    objc_thread_t writer = data->writer.load(std::memory_order_relaxed);
+    if (!objc_thread_equal(writer, objc_thread_self())) return 0;
+    return (unsigned)data->writers.load(std::memory_order_relaxed);
+}
+
+static void printContentionAtExit()
+{
+    _objc_sync_printContention();
+}
+
+// Only @synchronized locks are profiled, not +initialize locks.
+static bool profilesContention(SyncData *data)
+{
+    return slowpath(ProfileSyncContention)  &&
+        data->kind == SyncKind::atSynchronize;
+}
+
+static void recordContention(id obj, SyncData *data, uint64_t waited)
+{
+    static std::atomic<bool> reportRegistered;
+    if (!reportRegistered.exchange(true, std::memory_order_relaxed)) {
+        atexit(printContentionAtExit);
+    }
+
+    data->contendedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    data->waitNanoseconds.fetch_add(waited, std::memory_order_relaxed);
+    if (!data->cls.load(std::memory_order_relaxed)) {
+        data->cls.store(obj->getIsa(), std::memory_order_relaxed);
+    }
+}
+
+// Locks data's mutex. When profiling, returns the time it started
+// waiting, or zero if it didn't have to wait.
+static uint64_t lockMutex(SyncData *data, bool profile)
+{
+    if (!profile) {
+        data->mutex.lock();
+        return 0;
+    }
+
+    data->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (data->mutex.tryLock()) return 0;
+    uint64_t start = nanoseconds();
+    data->mutex.lock();
+    return start;
+}
+
+// Only objects that have been locked shared use rwlock, so exclusive
+// locks of anything else take the mutex alone. The caller holds the
+// mutex, which keeps sharedUsed from changing.
+static bool usesRWLock(SyncData *data)
+{
+    return data->sharedUsed.load(std::memory_order_relaxed);
+}
+
+// Makes exclusive holders of data take rwlock from now on. Setting
+// sharedUsed with the mutex held waits out any exclusive holder that
+// took the mutex alone. The acquire load pairs with the release store,
+// so a shared holder sees everything that holder did.
+static void enableShared(SyncData *data)
+{
+    if (data->sharedUsed.load(std::memory_order_acquire)) return;
+    data->mutex.lock();
+    data->sharedUsed.store(true, std::memory_order_release);
+    data->mutex.unlock();
+}
+
+// Takes data's lock exclusively: the mutex, and rwlock for writing.
+// firstUse is true if this thread had no lock of data before.
+// rwlock blocks new shared holders while the writer waits for the
+// shared holders that got in first.
+static void lockExclusive(id obj, SyncData *data, bool firstUse)
+{
+    bool profile = profilesContention(data);
+    uint64_t waitStart = lockMutex(data, profile);
+    // A recursive lock never waits.
+    if (data->writers.fetch_add(1) != 0) return;
+
+    if (!firstUse) {
+        // This thread holds data shared and nothing else.
+        _objc_fatal("objc_sync_enter(%p): cannot lock exclusively "
+                    "while holding a shared lock", (void *)obj);
+    }
+    if (usesRWLock(data)  &&  !data->rwlock.tryLock()) {
+        if (profile  &&  !waitStart) waitStart = nanoseconds();
+        data->rwlock.lock();
+    }
+    data->writer.store(objc_thread_self(), std::memory_order_relaxed);
+
+    if (waitStart) recordContention(obj, data, nanoseconds() - waitStart);
+}
+
+static bool tryLockExclusive(SyncData *data, bool firstUse)
+{
+    if (!data->mutex.tryLock()) return false;
+    if (data->writers.fetch_add(1) != 0) return true;
+
+    if (!firstUse  ||  (usesRWLock(data)  &&  !data->rwlock.tryLock())) {
+        data->writers.fetch_sub(1);
+        data->mutex.unlock();
+        return false;
+    }
+    data->writer.store(objc_thread_self(), std::memory_order_relaxed);
+    return true;
+}
+
+// Drops one level of the exclusive lock, leaving the mutex to the caller.
+// Returns false if this thread doesn't hold data exclusively.
+static bool releaseExclusive(SyncData *data)
+{
+    objc_thread_t writer = data->writer.load(std::memory_order_relaxed);
+    if (!objc_thread_equal(writer, objc_thread_self())) return false;
+
+    if (data->writers.load(std::memory_order_relaxed) == 1) {
+        data->writer.store(objc_thread_t{}, std::memory_order_relaxed);
+        data->writers.fetch_sub(1);
+        if (usesRWLock(data)) data->rwlock.unlock();
+    } else {
+        data->writers.fetch_sub(1);
+    }
+    return true;
+}
+
+static bool unlockExclusive(SyncData *data)
+{
+    if (!releaseExclusive(data)) return false;
+    return data->mutex.tryUnlock();
+}
+
+// Takes data's lock shared. Any number of threads may hold it shared at
+// once, but not while another thread holds it exclusively. Only the
+// thread's first lock of data takes rwlock, and only its last unlock
+// releases it (see _objc_sync_exit_shared), so a thread that already
+// holds data either way never waits here.
+static void lockShared(id obj, SyncData *data, bool firstUse)
+{
+    bool profile = profilesContention(data);
+    if (profile) {
+        data->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!firstUse) return;
+
+    enableShared(data);
+    if (!profile) {
+        data->rwlock.lockShared();
+        return;
+    }
+    if (data->rwlock.tryLockShared()) return;
+    uint64_t waitStart = nanoseconds();
+    data->rwlock.lockShared();
+    recordContention(obj, data, nanoseconds() - waitStart);
+}
+
+
 BREAKPOINT_FUNCTION(
     void objc_sync_nil(void)
 );
@@ -336,9 +861,17 @@ int _objc_sync_enter_kind(id obj, SyncKind kind)
     int result = OBJC_SYNC_SUCCESS;
 
     if (obj) {
-        SyncData* data = id2data(obj, kind, ACQUIRE);
+#if ENABLE_THIN_LOCKS
+        bool thin = usesThinLock(obj, kind);
+        if (thin  &&  thinEnter(obj)) return result;
+#endif
+        bool firstUse = false;
+        SyncData* data = id2data(obj, kind, ACQUIRE, &firstUse);
         ASSERT(data);
-        data->mutex.lock();
+#if ENABLE_THIN_LOCKS
+        if (thin  &&  firstUse) waitForThinOwner(obj);
+#endif
+        lockExclusive(obj, data, firstUse);
     } else {
         // @synchronized(nil) does nothing
         if (DebugNilSync) {
@@ -357,9 +890,26 @@ BOOL objc_sync_try_enter(id obj)
     BOOL result = YES;
 
     if (obj) {
-        SyncData* data = id2data(obj, SyncKind::atSynchronize, ACQUIRE);
+#if ENABLE_THIN_LOCKS
+        bool thin = usesThinLock(obj, SyncKind::atSynchronize);
+        if (thin  &&  thinEnter(obj)) return result;
+#endif
+        bool firstUse = false;
+        SyncData* data = id2data(obj, SyncKind::atSynchronize, ACQUIRE,
+                                 &firstUse);
         ASSERT(data);
-        result = data->mutex.tryLock();
+#if ENABLE_THIN_LOCKS
+        if (thin  &&  firstUse  &&  isLockedThin(obj)) result = NO;
+        else
+#endif
+        result = tryLockExclusive(data, firstUse);
+        if (!result) {
+            // Don't keep the entry cached for a lock this thread
+            // doesn't hold.
+            bool lastRelease = false;
+            id2data(obj, SyncKind::atSynchronize, RELEASE, &lastRelease);
+            if (lastRelease) dropThread(data);
+        }
     } else {
         // @synchronized(nil) does nothing
         if (DebugNilSync) {
@@ -390,14 +940,30 @@ int _objc_sync_exit_kind(id obj, SyncKind kind)
     int result = OBJC_SYNC_SUCCESS;
     
     if (obj) {
-        SyncData* data = id2data(obj, kind, RELEASE);
+#if ENABLE_THIN_LOCKS
+        bool thin = usesThinLock(obj, kind);
+        if (thin  &&  thinExit(obj)) return result;
+#endif
+        // The thread's shared locks nested in this exclusive lock hold
+        // no rwlock of their own, so the last exclusive lock can't be
+        // released before them. Check before id2data drops a lock.
+        unsigned lockCount = 0;
+        SyncData *held = heldData(obj, kind, &lockCount);
+        unsigned exclusive = held ? exclusiveCount(held) : 0;
+        if (exclusive == 0  ||  (exclusive == 1  &&  lockCount > 1)) {
+            return OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
+        }
+
+        bool lastRelease = false;
+        SyncData* data = id2data(obj, kind, RELEASE, &lastRelease);
         if (!data) {
             result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
         } else {
-            bool okay = data->mutex.tryUnlock();
+            bool okay = unlockExclusive(data);
             if (!okay) {
                 result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
             }
+            if (lastRelease) dropThread(data);
         }
     } else {
         // @synchronized(nil) does nothing
@@ -407,10 +973,94 @@ int _objc_sync_exit_kind(id obj, SyncKind kind)
     return result;
 }
 
+
+// Begin synchronizing on 'obj' shared with other shared holders.
+// Shared holders exclude objc_sync_enter holders but not each other.
+int _objc_sync_enter_shared(id obj)
+{
+    int result = OBJC_SYNC_SUCCESS;
+
+    if (obj) {
+#if ENABLE_THIN_LOCKS
+        bool thin = usesThinLock(obj, SyncKind::atSynchronize);
+        // Already held exclusively, so nest inside that.
+        if (thin  &&  syncData == thinEntry(obj)) {
+            syncLockCount++;
+            return result;
+        }
+#endif
+        bool firstUse = false;
+        SyncData* data = id2data(obj, SyncKind::atSynchronize, ACQUIRE,
+                                 &firstUse);
+        ASSERT(data);
+#if ENABLE_THIN_LOCKS
+        if (thin  &&  firstUse) waitForThinOwner(obj);
+#endif
+        lockShared(obj, data, firstUse);
+    } else {
+        // @synchronized(nil) does nothing
+        if (DebugNilSync) {
+            _objc_inform("NIL SYNC DEBUG: @synchronized(nil); set a breakpoint on objc_sync_nil to debug");
+        }
+        objc_sync_nil();
+        if (DebugNilSync == Fatal)
+            _objc_fatal("@synchronized(nil) is fatal");
+    }
+
+    return result;
+}
+
+int _objc_sync_exit_shared(id obj)
+{
+    int result = OBJC_SYNC_SUCCESS;
+
+    if (obj) {
+#if ENABLE_THIN_LOCKS
+        bool thin = usesThinLock(obj, SyncKind::atSynchronize);
+        // Shared locks nested in a thin lock only add to its count, and
+        // the first lock counted is the exclusive one.
+        bool heldThin = thin  &&  syncData == thinEntry(obj);
+        if (heldThin  &&  syncLockCount > 1  &&  thinExit(obj)) return result;
+#else
+        bool heldThin = false;
+#endif
+        // Check that the thread holds a shared lock before id2data
+        // drops one.
+        unsigned lockCount = 0;
+        SyncData *held = heldData(obj, SyncKind::atSynchronize, &lockCount);
+        if (heldThin  ||  !held  ||  lockCount <= exclusiveCount(held)) {
+            result = OBJC_SYNC_NOT_OWNING_THREAD_ERROR;
+        } else {
+            bool lastRelease = false;
+            SyncData* data = id2data(obj, SyncKind::atSynchronize, RELEASE,
+                                     &lastRelease);
+            ASSERT(data == held);
+            if (lastRelease) {
+                // The thread holds no exclusive lock, so its first lock
+                // of data was shared and holds rwlock.
+                data->rwlock.unlockShared();
+                dropThread(data);
+            }
+        }
+    }
+
+    if (result != OBJC_SYNC_SUCCESS)
+        OBJC_DEBUG_OPTION_REPORT_ERROR(DebugSyncErrors,
+            "_objc_sync_exit_shared(%p) returned error %d", obj, result);
+    return result;
+}
+
 void _objc_sync_exit_forked_child(id obj, SyncKind kind)
 {
-    SyncData *data = id2data(obj, kind, RELEASE);
+    bool lastRelease = false;
+    SyncData *data = id2data(obj, kind, RELEASE, &lastRelease);
+    // The thread's identity may have changed across fork().
+    if (data->writers.fetch_sub(1) == 1) {
+        data->writer.store(objc_thread_t{}, std::memory_order_relaxed);
+        if (usesRWLock(data)) data->rwlock.reset();
+    }
     data->mutex.unlockForkedChild();
+    if (lastRelease) dropThread(data);
 }
 
 void _objc_sync_assert_locked(id obj, SyncKind kind)
@@ -419,7 +1069,9 @@ void _objc_sync_assert_locked(id obj, SyncKind kind)
     SyncData *data = id2data(obj, kind, ACQUIRE);
     ASSERT(data);
     lockdebug::assert_locked(&data->mutex);
-    id2data(obj, kind, RELEASE);
+    bool lastRelease = false;
+    id2data(obj, kind, RELEASE, &lastRelease);
+    if (lastRelease) dropThread(data);
 #endif
 }
 
@@ -432,21 +1084,109 @@ void _objc_sync_assert_unlocked(id obj, SyncKind kind)
 #endif
 }
 
+// Locks held thin have no mutex and are not reported.
 void _objc_sync_foreach_lock(void (^call)(id obj, SyncKind kind, recursive_mutex_t *mutex))
 {
     sDataLists.lockAll();
 
     sDataLists.forEach([&call](SyncList &list) {
-        SyncData *data = list._data;
-        while (data) {
+        list.forEach([&call](SyncData *data) {
             call((id)(objc_object *)data->object, data->kind, &data->mutex);
-            data = data->nextData;
+        });
+    });
+
+    sDataLists.unlockAll();
+}
+
+void _objc_sync_getStatistics(objc_sync_statistics_t *stats)
+{
+    bzero(stats, sizeof(*stats));
+
+    sDataLists.lockAll();
+
+    sDataLists.forEach([stats](SyncList &list) {
+        stats->capacity += list._capacity;
+        stats->entriesReclaimed += list._reclaimed;
+        uint32_t mask = list._capacity - 1;
+        for (uint32_t i = 0; i < list._capacity; i++) {
+            SyncData *data = list._table[i];
+            if (!data) continue;
+            if (SyncList::isIdle(data)) stats->idleEntries++;
+            else stats->liveEntries++;
+            uint32_t home = SyncList::hash((id)(objc_object *)data->object,
+                                           data->kind) & mask;
+            uint32_t probe = ((i - home) & mask) + 1;
+            if (probe > stats->maxProbeLength) stats->maxProbeLength = probe;
         }
     });
 
     sDataLists.unlockAll();
 }
 
+void _objc_sync_enumerateContention(void (^block)(const objc_sync_contention_t *record))
+{
+    // Copy the records out so that the block may use @synchronized.
+    objc_sync_contention_t *records = nil;
+    size_t count = 0;
+    size_t allocated = 0;
+
+    sDataLists.lockAll();
+
+    sDataLists.forEach([&](SyncList &list) {
+        list.forEach([&](SyncData *data) {
+            if (data->acquisitions.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+            if (count == allocated) {
+                allocated = allocated ? allocated * 2 : 64;
+                records = (objc_sync_contention_t *)
+                    realloc(records, allocated * sizeof(*records));
+            }
+            objc_sync_contention_t *record = &records[count++];
+            record->object = (objc_object *)data->object;
+            record->cls = data->cls.load(std::memory_order_relaxed);
+            record->acquisitions =
+                data->acquisitions.load(std::memory_order_relaxed);
+            record->contendedAcquisitions =
+                data->contendedAcquisitions.load(std::memory_order_relaxed);
+            record->waitNanoseconds =
+                data->waitNanoseconds.load(std::memory_order_relaxed);
+        });
+    });
+
+    sDataLists.unlockAll();
+
+    for (size_t i = 0; i < count; i++) {
+        block(&records[i]);
+    }
+    free(records);
+}
+
+void _objc_sync_printContention(void)
+{
+    __block std::vector<objc_sync_contention_t> records;
+    _objc_sync_enumerateContention(^(const objc_sync_contention_t *record) {
+        if (record->contendedAcquisitions) records.push_back(*record);
+    });
+    std::sort(records.begin(), records.end(),
+              [](const objc_sync_contention_t &a,
+                 const objc_sync_contention_t &b) {
+        return a.waitNanoseconds > b.waitNanoseconds;
+    });
+
+    _objc_inform("##############");
+    _objc_inform("SYNC CONTENTION (%zu locks)", records.size());
+    for (const objc_sync_contention_t &record : records) {
+        _objc_inform("SYNC %p %s: %llu acquisitions, %llu contended, "
+                     "%llu us waiting", record.object,
+                     record.cls ? class_getName(record.cls) : "(unknown)",
+                     (unsigned long long)record.acquisitions,
+                     (unsigned long long)record.contendedAcquisitions,
+                     (unsigned long long)(record.waitNanoseconds / 1000));
+    }
+    _objc_inform("##############");
+}
+
 void _objc_sync_lock_atfork_prepare(void)
 {
     sDataLists.lockAll();
@@ -461,6 +1201,16 @@ void _objc_sync_lock_atfork_child(void)
 {
     sDataLists.forceResetAll();
 
+#if ENABLE_THIN_LOCKS
+    // Thin locks held by other threads will never be released, and the
+    // entries counted in inflated are destroyed below.
+    for (unsigned i = 0; i < THIN_LOCK_COUNT; i++) {
+        thinLocks[i].lock.reset();
+        thinLocks[i].owner.store(0, std::memory_order_relaxed);
+        thinLocks[i].inflated.store(0, std::memory_order_relaxed);
+    }
+#endif
+
     // The per-thread cache could hold stale data, clear it.
     clearSyncCache();
 
@@ -474,12 +1224,21 @@ void _objc_sync_lock_atfork_child(void)
     //    inefficient and there are no other active threads in the child so safe
     //    deallocation is trivial.
     sDataLists.forEach([](SyncList &list) {
-        SyncData *data = list._data;
+        list.forEach([](SyncData *data) {
+            free(data);
+        });
+        free(list._table);
+        list._table = NULL;
+        list._capacity = 0;
+        list._count = 0;
+
+        SyncData *data = list._spares;
         while (data) {
             SyncData *next = data->nextData;
             free(data);
             data = next;
         }
-        list._data = NULL;
+        list._spares = NULL;
+        list._spareCount = 0;
     });
 }
@@ -26,6 +26,7 @@
 * Parsing of old-style type strings.
 **********************************************************************/
 
+#include "DenseMapExtras.h"
 #include "objc-private.h"
 
 #include <algorithm>
@@ -34,9 +35,11 @@
 * SubtypeUntil.
 *
 * Delegation.
+* Returns -1 for a malformed type if fatal is false.
 **********************************************************************/
 static int	SubtypeUntil	       (const char *	type,
-                                char		end)
+                                char		end,
+                                bool		fatal = true)
 {
     int		level = 0;
     const char *	head = type;
@@ -56,6 +59,7 @@ static int	SubtypeUntil	       (const char *	type,
         type += 1;
     }
 
+    if (!fatal) return -1;
     _objc_fatal ("Object: SubtypeUntil: end of type encountered prematurely\n");
     return 0;
 }
@@ -63,9 +67,13 @@ static int	SubtypeUntil	       (const char *	type,
 
 /***********************************************************************
 * SkipFirstType.
+* Returns nil for a malformed type if fatal is false.
 **********************************************************************/
-static const char *	SkipFirstType	   (const char *	type)
+static const char *	SkipFirstType	   (const char *	type,
+                                    bool		fatal = true)
 {
+    int len;
+
     while (1)
     {
         switch (*type++)
@@ -87,15 +95,18 @@ static const char *	SkipFirstType	   (const char *	type)
             case '[':
                 while ((*type >= '0') && (*type <= '9'))
                     type += 1;
-                return type + SubtypeUntil (type, ']') + 1;
+                len = SubtypeUntil (type, ']', fatal);
+                return len < 0 ? nil : type + len + 1;
 
                 /* structures */
             case '{':
-                return type + SubtypeUntil (type, '}') + 1;
+                len = SubtypeUntil (type, '}', fatal);
+                return len < 0 ? nil : type + len + 1;
 
                 /* unions */
             case '(':
-                return type + SubtypeUntil (type, ')') + 1;
+                len = SubtypeUntil (type, ')', fatal);
+                return len < 0 ? nil : type + len + 1;
 
                 /* basic types */
             default:
@@ -105,6 +116,160 @@ static const char *	SkipFirstType	   (const char *	type)
 }
 
 
+/***********************************************************************
+* Method signatures
+* Finding an argument in a type encoding means parsing every argument
+* before it. encoding_getSignature() parses an encoding once into a
+* method_signature_t and keeps it. Signatures are interned by the
+* contents of the encoding, so every method with the same encoding
+* shares one, and they are never freed.
+*
+* SignatureCache is a direct-mapped cache in front of the interned
+* signatures, indexed by the address of the encoding string. Its entries
+* are signature keys. An encoding in an image's read-only data is never
+* freed, so its key records its address and a hit is one pointer
+* comparison. Any other encoding may be freed and its address reused for
+* a different one, so it uses the signature's shared key, whose types is
+* nil, and a hit compares the strings. Misses take TypeEncodingCacheLock
+* and look up or create the key. Keys are never freed either.
+**********************************************************************/
+#define SIGNATURE_CACHE_SIZE 1024
+
+struct signature_key_t {
+    const char *types;  // the encoding's address, or nil
+    method_signature_t *sig;
+};
+
+mutex_t TypeEncodingCacheLock;
+// Shared keys, by encoding contents.
+static objc::DenseMap<const char *, signature_key_t *> *Signatures;
+// Keys of read-only encodings, by address.
+static objc::DenseMap<const void *, signature_key_t *> *ImmutableSignatures;
+static signature_key_t *SignatureCache[SIGNATURE_CACHE_SIZE];
+
+// Skips the register parameter hint and the (possibly negative) argument
+// offset after an argument's type, returning the offset.
+static int ParseArgumentOffset(const char *&typedesc)
+{
+    int offset = 0;
+    bool offset_is_negative = NO;
+
+    if (*typedesc == '+') typedesc++;
+    if (*typedesc == '-') {
+        offset_is_negative = YES;
+        typedesc += 1;
+    }
+    while ((*typedesc >= '0') && (*typedesc <= '9'))
+        offset = offset * 10 + (*typedesc++ - '0');
+
+    return offset_is_negative ? -offset : offset;
+}
+
+// Returns nil instead of dying if the encoding is malformed.
+static method_signature_t *
+ParseSignature(const char *types)
+{
+    size_t typesLen = strlen(types);
+    if (typesLen == 0  ||  typesLen > UINT32_MAX) return nil;
+
+    // Count the arguments.
+    const char *typedesc = SkipFirstType(types, false);
+    if (!typedesc) return nil;
+    while ((*typedesc >= '0') && (*typedesc <= '9'))
+        typedesc += 1;
+    const char *args = typedesc;
+    uint32_t nargs = 0;
+    while (*typedesc) {
+        typedesc = SkipFirstType(typedesc, false);
+        if (!typedesc) return nil;
+        ParseArgumentOffset(typedesc);
+        nargs++;
+    }
+
+    // The signature's copy of the string follows its argument array.
+    size_t size = sizeof(method_signature_t) +
+        nargs * sizeof(method_signature_t::argument_t);
+    auto sig = (method_signature_t *)malloc(size + typesLen + 1);
+    memcpy((char *)sig + size, types, typesLen + 1);
+    sig->types = (char *)sig + size;
+    sig->argumentCount = nargs;
+    sig->frameSize = encoding_getSizeOfArguments(types);
+    sig->returnType = { 0, (uint32_t)(SkipFirstType(types) - types), 0 };
+
+    int self_offset = 0;
+    typedesc = args;
+    for (uint32_t i = 0; i < nargs; i++) {
+        auto &arg = sig->arguments[i];
+        const char *end = SkipFirstType(typedesc);
+        arg.typeStart = (uint32_t)(typedesc - types);
+        arg.typeLength = (uint32_t)(end - typedesc);
+        typedesc = end;
+        int offset = ParseArgumentOffset(typedesc);
+        if (i == 0) {
+            self_offset = offset;
+            arg.offset = 0;
+        } else {
+            arg.offset = offset - self_offset;
+        }
+    }
+
+    return sig;
+}
+
+
+/***********************************************************************
+* encoding_getSignature.
+* Returns the parsed signature of a method type encoding,
+* or nil if the encoding is malformed.
+* Locking: acquires TypeEncodingCacheLock on a cache miss
+**********************************************************************/
+const method_signature_t *
+encoding_getSignature(const char *types)
+{
+    if (!types) return nil;
+
+    auto entry = explicit_atomic<signature_key_t *>::from_pointer
+        (&SignatureCache[ptr_hash((uintptr_t)types) % SIGNATURE_CACHE_SIZE]);
+    signature_key_t *key = entry->load(std::memory_order_acquire);
+    if (fastpath(key)) {
+        if (fastpath(key->types == types)) return key->sig;
+        if (!key->types  &&  strcmp(key->sig->types, types) == 0) {
+            return key->sig;
+        }
+    }
+
+    {
+        mutex_locker_t lock(TypeEncodingCacheLock);
+        if (!Signatures) {
+            Signatures = new objc::DenseMap<const char *, signature_key_t *>{};
+            ImmutableSignatures =
+                new objc::DenseMap<const void *, signature_key_t *>{};
+        }
+        auto it = ImmutableSignatures->find(types);
+        if (it != ImmutableSignatures->end()) {
+            key = it->second;
+        } else {
+            auto shared = Signatures->find(types);
+            if (shared != Signatures->end()) {
+                key = shared->second;
+            } else {
+                method_signature_t *sig = ParseSignature(types);
+                if (!sig) return nil;
+                key = new signature_key_t{nil, sig};
+                Signatures->insert({sig->types, key});
+            }
+            if (_dyld_is_memory_immutable(types, strlen(types) + 1)) {
+                key = new signature_key_t{types, key->sig};
+                ImmutableSignatures->insert({types, key});
+            }
+        }
+    }
+
+    entry->store(key, std::memory_order_release);
+    return key->sig;
+}
+
+
 /***********************************************************************
 * encoding_getNumberOfArguments.
 **********************************************************************/
@@ -113,6 +278,10 @@ encoding_getNumberOfArguments(const char *typedesc)
 {
     unsigned nargs;
 
+    if (auto sig = encoding_getSignature(typedesc)) {
+        return sig->argumentCount;
+    }
+
     // First, skip the return type
     typedesc = SkipFirstType (typedesc);
 
@@ -176,6 +345,17 @@ encoding_getArgumentInfo(const char *typedesc, unsigned int arg,
     int self_offset = 0;
     bool offset_is_negative = NO;
 
+    if (auto sig = encoding_getSignature(typedesc)) {
+        if (arg < sig->argumentCount) {
+            *type = typedesc + sig->arguments[arg].typeStart;
+            *offset = sig->arguments[arg].offset;
+            return arg;
+        }
+        *type = 0;
+        *offset = 0;
+        return sig->argumentCount;
+    }
+
     // First, skip the return type
     typedesc = SkipFirstType (typedesc);
 
@@ -312,13 +492,35 @@ encoding_copyReturnType(const char *t)
 }
 
 
+/***********************************************************************
+* encoding_findArgumentType.  Returns the start of a single argument's
+* type string in t, and its length in *len, or nil if there is no such
+* argument.
+**********************************************************************/
+static const char *
+encoding_findArgumentType(const char *t, unsigned int index, size_t *len)
+{
+    int offset;
+
+    if (auto sig = encoding_getSignature(t)) {
+        if (index >= sig->argumentCount) return nil;
+        *len = sig->arguments[index].typeLength;
+        return t + sig->arguments[index].typeStart;
+    }
+
+    encoding_getArgumentInfo(t, index, &t, &offset);
+    if (!t) return nil;
+
+    *len = SkipFirstType(t) - t;
+    return t;
+}
+
+
 void 
 encoding_getArgumentType(const char *t, unsigned int index, 
                          char *dst, size_t dst_len)
 {
     size_t len;
-    const char *end;
-    int offset;
 
     if (!dst) return;
     if (!t) {
@@ -326,15 +528,13 @@ encoding_getArgumentType(const char *t, unsigned int index,
         return;
     }
 
-    encoding_getArgumentInfo(t, index, &t, &offset);
+    t = encoding_findArgumentType(t, index, &len);
 
     if (!t) {
         strncpy(dst, "", dst_len);
         return;
     }
 
-    end = SkipFirstType(t);
-    len = end - t;
     strncpy(dst, t, std::min(len, dst_len));
     if (len < dst_len) memset(dst+len, 0, dst_len - len);
 }
@@ -348,18 +548,14 @@ char *
 encoding_copyArgumentType(const char *t, unsigned int index)
 {
     size_t len;
-    const char *end;
     char *result;
-    int offset;
 
     if (!t) return NULL;
 
-    encoding_getArgumentInfo(t, index, &t, &offset);
+    t = encoding_findArgumentType(t, index, &len);
 
     if (!t) return NULL;
 
-    end = SkipFirstType(t);
-    len = end - t;
     result = (char *)malloc(len + 1);
     strncpy(result, t, len);
     result[len] = '\0';
@@ -121,6 +121,17 @@ struct weak_table_t {
     size_t    num_entries;
     uintptr_t mask;
     uintptr_t max_hash_displacement;
+
+    // Statistics for _objc_weak_getStatistics().
+    // Updated with the side table lock held.
+    size_t    num_referrers;
+    // Entries with 1, 2, 3-4, 5-8, ... 33-64, and more than 64 referrers.
+    size_t    referrers_histogram[8];
+    uint64_t  grow_count;
+    uint64_t  compact_count;
+    uint64_t  clear_count;
+    uint64_t  clear_nanoseconds;
+    uint64_t  max_clear_nanoseconds;
 };
 
 enum WeakRegisterDeallocatingOptions {
@@ -144,6 +155,66 @@ bool weak_is_registered_no_lock(weak_table_t *weak_table, id referent);
 /// Called on object destruction. Sets all remaining weak pointers to nil.
 void weak_clear_no_lock(weak_table_t *weak_table, id referent);
 
+/**
+ * A hazard pointer published by a thread performing a lock-free weak load.
+ * A thread stores the object it is about to retain in its hazard, then
+ * re-reads the weak variable. If the variable still holds the object, the
+ * object cannot be freed until the hazard is cleared, because the thread
+ * clearing its weak references waits in weak_wait_for_readers().
+ * Lock-free atomic property getters use the same record; atomic setters
+ * wait in weak_wait_for_readers() before releasing the old value.
+ * Records are never freed; they are recycled when their thread exits.
+ */
+struct weak_hazard_t {
+    explicit_atomic<objc_object *> referent{nil};
+    explicit_atomic<bool> inUse{false};
+    weak_hazard_t *next{nil};
+};
+
+/// Finds or creates the calling thread's hazard record.
+/// Returns nil if the thread has no objc per-thread data.
+weak_hazard_t *weak_hazard_for_thread_slow(void);
+
+/// Returns a thread's hazard record to the pool when the thread exits.
+void weak_hazard_destroy(weak_hazard_t *hazard);
+
+/// Called on object destruction after the object's weak references have
+/// been cleared. Waits until no lock-free weak load still refers to it.
+void weak_wait_for_readers(objc_object *referent);
+
+/// The number of threads between weak_hazard_enter() and
+/// weak_hazard_leave(). weak_wait_for_readers() doesn't look at the
+/// hazard records while it is zero.
+extern explicit_atomic<uintptr_t> weak_hazard_readers;
+
+/// Called before a lock-free load publishes its first hazard. A reader
+/// that enters after weak_wait_for_readers() saw no readers sees the
+/// cleared variable when it re-reads it, so it never protects the object.
+static inline void weak_hazard_enter(void)
+{
+    weak_hazard_readers.fetch_add(1, std::memory_order_seq_cst);
+}
+
+/// Clears hazard and ends the load.
+static inline void weak_hazard_leave(weak_hazard_t *hazard)
+{
+    hazard->referent.store(nil, std::memory_order_release);
+    weak_hazard_readers.fetch_sub(1, std::memory_order_release);
+}
+
 __END_DECLS
 
+/// The calling thread's hazard record, once weak_hazard_for_thread_slow()
+/// has found it. Cleared by weak_hazard_destroy().
+extern tls_direct(weak_hazard_t *, tls_key::weak_hazard) weak_hazard_tls;
+
+/// Returns the calling thread's hazard record, creating it if necessary.
+/// Returns nil if the thread has no objc per-thread data.
+static inline weak_hazard_t *weak_hazard_for_thread(void)
+{
+    weak_hazard_t *hazard = weak_hazard_tls;
+    if (fastpath(hazard)) return hazard;
+    return weak_hazard_for_thread_slow();
+}
+
 #endif /* _OBJC_WEAK_H_ */
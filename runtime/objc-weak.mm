@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sched.h>
 
 #define TABLE_SIZE(entry) (entry->mask ? entry->mask + 1 : 0)
 
@@ -71,20 +72,75 @@ static inline uintptr_t w_hash_pointer(objc_object **key) {
     return ptr_hash((uintptr_t)key);
 }
 
+/*
+ * Referrer arrays are scanned WEAK_GROUP_SIZE entries at a time.
+ * The inline array is exactly one group, and out-of-line tables are
+ * always a power of two of at least WEAK_GROUP_SIZE entries, so groups
+ * never straddle the end of a table. Group compares are written with
+ * clang vector extensions and become NEON or SSE compares.
+ */
+#define WEAK_GROUP_SIZE 4
+static_assert(WEAK_GROUP_SIZE == WEAK_INLINE_COUNT,
+              "the inline referrers must be exactly one group");
+static_assert(sizeof(weak_referrer_t) == sizeof(uintptr_t),
+              "weak_referrer_t must be pointer-sized");
+
+typedef uintptr_t weak_group_t __attribute__((ext_vector_type(WEAK_GROUP_SIZE)));
+typedef intptr_t weak_group_mask_t __attribute__((ext_vector_type(WEAK_GROUP_SIZE)));
+
+static inline weak_group_t weak_group_load(const weak_referrer_t *referrers) {
+    weak_group_t group;
+    memcpy(&group, referrers, sizeof(group));
+    return group;
+}
+
+// Disguised nil is 0, so an empty group is all zero.
+static inline weak_group_t weak_group_splat(objc_object **referrer) {
+    weak_referrer_t disguised = referrer;
+    uintptr_t bits;
+    memcpy(&bits, &disguised, sizeof(bits));
+    return (weak_group_t)bits;
+}
+
+static inline bool weak_group_any(weak_group_mask_t match) {
+    return (match[0] | match[1] | match[2] | match[3]) != 0;
+}
+
+// Index of the first lane at or after `first` that equals `value`, or -1.
+static inline int weak_group_find(weak_group_t group, weak_group_t value,
+                                  unsigned first = 0) {
+    weak_group_mask_t match = (group == value);
+    if (!weak_group_any(match)) return -1;
+    for (unsigned i = first; i < WEAK_GROUP_SIZE; i++) {
+        if (match[i]) return (int)i;
+    }
+    return -1;
+}
+
+// Large referrer tables are kept sparser so that objects with thousands
+// of weak references still have short probe sequences.
+#define WEAK_REFS_LARGE_TABLE 1024
+
+static inline bool referrers_need_grow(weak_entry_t *entry) {
+    size_t size = TABLE_SIZE(entry);
+    if (size >= WEAK_REFS_LARGE_TABLE) return entry->num_refs >= size / 2;
+    return entry->num_refs >= size * 3 / 4;
+}
+
 /** 
- * Grow the entry's hash table of referrers. Rehashes each
+ * Resize the entry's hash table of referrers. Rehashes each
  * of the referrers.
  * 
  * @param entry Weak pointer hash set for a particular object.
+ * @param new_size The new table size. Must be a power of two.
  */
 __attribute__((noinline, used))
-static void grow_refs_and_insert(weak_entry_t *entry, 
-                                 objc_object **new_referrer)
+static void resize_refs(weak_entry_t *entry, size_t new_size)
 {
     ASSERT(entry->out_of_line());
+    ASSERT(new_size >= WEAK_GROUP_SIZE);
 
     size_t old_size = TABLE_SIZE(entry);
-    size_t new_size = old_size ? old_size * 2 : 8;
 
     size_t num_refs = entry->num_refs;
     weak_referrer_t *old_refs = entry->referrers;
@@ -101,11 +157,40 @@ static void grow_refs_and_insert(weak_entry_t *entry,
             num_refs--;
         }
     }
-    // Insert
-    append_referrer(entry, new_referrer);
     if (old_refs) free(old_refs);
 }
 
+/** 
+ * Grow the entry's hash table of referrers and insert a new referrer.
+ * 
+ * @param entry Weak pointer hash set for a particular object.
+ * @param new_referrer The new weak pointer to be added.
+ */
+static void grow_refs_and_insert(weak_entry_t *entry, 
+                                 objc_object **new_referrer)
+{
+    size_t old_size = TABLE_SIZE(entry);
+    resize_refs(entry, old_size ? old_size * 2 : 8);
+    append_referrer(entry, new_referrer);
+}
+
+/** 
+ * Shrink the entry's hash table of referrers if it is mostly empty.
+ * This also resets max_hash_displacement, which otherwise only grows.
+ * 
+ * @param entry Weak pointer hash set for a particular object.
+ */
+static void compact_refs_maybe(weak_entry_t *entry)
+{
+    size_t old_size = TABLE_SIZE(entry);
+
+    // Shrink if larger than 64 referrers and at most 1/16 full.
+    if (old_size >= 64  &&  old_size / 16 >= entry->num_refs) {
+        resize_refs(entry, old_size / 4);
+        // leaves new table no more than 1/4 full
+    }
+}
+
 /** 
  * Add the given referrer to set of weak pointers in this entry.
  * Does not perform duplicate checking (b/c weak pointers are never
@@ -116,13 +201,14 @@ static void grow_refs_and_insert(weak_entry_t *entry,
  */
 static void append_referrer(weak_entry_t *entry, objc_object **new_referrer)
 {
+    weak_group_t empty = weak_group_splat(nil);
+
     if (! entry->out_of_line()) {
         // Try to insert inline.
-        for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
-            if (entry->inline_referrers[i] == nil) {
-                entry->inline_referrers[i] = new_referrer;
-                return;
-            }
+        int i = weak_group_find(weak_group_load(entry->inline_referrers), empty);
+        if (i >= 0) {
+            entry->inline_referrers[i] = new_referrer;
+            return;
         }
 
         // Couldn't insert inline. Allocate out of line.
@@ -142,17 +228,31 @@ static void append_referrer(weak_entry_t *entry, objc_object **new_referrer)
 
     ASSERT(entry->out_of_line());
 
-    if (entry->num_refs >= TABLE_SIZE(entry) * 3/4) {
+    if (referrers_need_grow(entry)) {
         return grow_refs_and_insert(entry, new_referrer);
     }
+
+    // Linear probing, one group at a time. Lanes before `begin` in the
+    // first group belong to other probe sequences and are skipped.
+    // The last iteration revisits the first group's skipped lanes, which
+    // are the end of this referrer's probe sequence.
     size_t begin = w_hash_pointer(new_referrer) & (entry->mask);
-    size_t index = begin;
-    size_t hash_displacement = 0;
-    while (entry->referrers[index] != nil) {
-        hash_displacement++;
-        index = (index+1) & entry->mask;
-        if (index == begin) bad_weak_table(entry);
+    size_t group = begin & ~(size_t)(WEAK_GROUP_SIZE-1);
+    unsigned first = (unsigned)(begin - group);
+    size_t groups = TABLE_SIZE(entry) / WEAK_GROUP_SIZE;
+    size_t index;
+    for (size_t n = 0; ; n++) {
+        if (n > groups) bad_weak_table(entry);
+        int lane = weak_group_find(weak_group_load(&entry->referrers[group]),
+                                   empty, first);
+        if (lane >= 0) {
+            index = group + lane;
+            break;
+        }
+        group = (group + WEAK_GROUP_SIZE) & entry->mask;
+        first = 0;
     }
+    size_t hash_displacement = (index - begin) & entry->mask;
     if (hash_displacement > entry->max_hash_displacement) {
         entry->max_hash_displacement = hash_displacement;
     }
@@ -164,20 +264,23 @@ static void append_referrer(weak_entry_t *entry, objc_object **new_referrer)
 /** 
  * Remove old_referrer from set of referrers, if it's present.
  * Does not remove duplicates, because duplicates should not exist. 
- * 
- * @todo this is slow if old_referrer is not present. Is this ever the case? 
+ *
+ * Referrers are unique, so a match anywhere in a probed group is the
+ * referrer being removed. Probing stops once every slot within
+ * max_hash_displacement of the referrer's hash has been examined.
  *
  * @param entry The entry holding the referrers.
  * @param old_referrer The referrer to remove. 
  */
 static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer)
 {
+    weak_group_t target = weak_group_splat(old_referrer);
+
     if (! entry->out_of_line()) {
-        for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
-            if (entry->inline_referrers[i] == old_referrer) {
-                entry->inline_referrers[i] = nil;
-                return;
-            }
+        int i = weak_group_find(weak_group_load(entry->inline_referrers), target);
+        if (i >= 0) {
+            entry->inline_referrers[i] = nil;
+            return;
         }
         REPORT_WEAK_ERROR("Attempted to unregister unknown __weak variable "
                           "at %p. This is probably incorrect use of "
@@ -187,22 +290,62 @@ static void remove_referrer(weak_entry_t *entry, objc_object **old_referrer)
     }
 
     size_t begin = w_hash_pointer(old_referrer) & (entry->mask);
-    size_t index = begin;
-    size_t hash_displacement = 0;
-    while (entry->referrers[index] != old_referrer) {
-        index = (index+1) & entry->mask;
-        if (index == begin) bad_weak_table(entry);
-        hash_displacement++;
-        if (hash_displacement > entry->max_hash_displacement) {
-            REPORT_WEAK_ERROR("Attempted to unregister unknown __weak variable "
-                              "at %p. This is probably incorrect use of "
-                              "objc_storeWeak() and objc_loadWeak().",
-                              old_referrer);
+    size_t group = begin & ~(size_t)(WEAK_GROUP_SIZE-1);
+    // Number of slots from the start of the first group to the end of the
+    // longest possible probe sequence for this referrer.
+    size_t remaining = (begin - group) + entry->max_hash_displacement + 1;
+    remaining = std::min(remaining, TABLE_SIZE(entry));
+    while (true) {
+        int lane = weak_group_find(weak_group_load(&entry->referrers[group]),
+                                   target);
+        if (lane >= 0) {
+            entry->referrers[group + lane] = nil;
+            entry->num_refs--;
+            compact_refs_maybe(entry);
             return;
         }
+        if (remaining <= WEAK_GROUP_SIZE) break;
+        remaining -= WEAK_GROUP_SIZE;
+        group = (group + WEAK_GROUP_SIZE) & entry->mask;
+    }
+
+    REPORT_WEAK_ERROR("Attempted to unregister unknown __weak variable "
+                      "at %p. This is probably incorrect use of "
+                      "objc_storeWeak() and objc_loadWeak().",
+                      old_referrer);
+}
+
+/**
+ * Return the number of weak references registered in entry.
+ */
+static size_t weak_entry_referrers(weak_entry_t *entry)
+{
+    if (entry->out_of_line()) return entry->num_refs;
+
+    size_t count = 0;
+    for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
+        if (entry->inline_referrers[i]) count++;
     }
-    entry->referrers[index] = nil;
-    entry->num_refs--;
+    return count;
+}
+
+/**
+ * Update the weak table's referrer statistics for an entry whose number
+ * of referrers changed from old_count to new_count. A count of 0 means
+ * the entry is not in the table.
+ */
+static void weak_count_referrers(weak_table_t *weak_table,
+                                 size_t old_count, size_t new_count)
+{
+    // 1, 2, 3-4, 5-8, ... >64
+    const size_t last = countof(weak_table->referrers_histogram) - 1;
+    auto bucket = [=](size_t count) {
+        size_t bucket = count <= 1 ? 0 : 64 - __builtin_clzll(count - 1);
+        return std::min(bucket, last);
+    };
+    if (old_count) weak_table->referrers_histogram[bucket(old_count)]--;
+    if (new_count) weak_table->referrers_histogram[bucket(new_count)]++;
+    weak_table->num_referrers += new_count - old_count;
 }
 
 /** 
@@ -265,6 +408,7 @@ static void weak_grow_maybe(weak_table_t *weak_table)
     // Grow if at least 3/4 full.
     if (weak_table->num_entries >= old_size * 3 / 4) {
         weak_resize(weak_table, old_size ? old_size*2 : 64);
+        weak_table->grow_count++;
     }
 }
 
@@ -277,6 +421,7 @@ static void weak_compact_maybe(weak_table_t *weak_table)
     if (old_size >= 1024  && old_size / 16 >= weak_table->num_entries) {
         weak_resize(weak_table, old_size / 8);
         // leaves new table no more than 1/2 full
+        weak_table->compact_count++;
     }
 }
 
@@ -357,21 +502,12 @@ weak_unregister_no_lock(weak_table_t *weak_table, id referent_id,
     if (!referent) return;
 
     if ((entry = weak_entry_for_referent(weak_table, referent))) {
+        size_t old_count = weak_entry_referrers(entry);
         remove_referrer(entry, referrer);
-        bool empty = true;
-        if (entry->out_of_line()  &&  entry->num_refs != 0) {
-            empty = false;
-        }
-        else {
-            for (size_t i = 0; i < WEAK_INLINE_COUNT; i++) {
-                if (entry->inline_referrers[i]) {
-                    empty = false; 
-                    break;
-                }
-            }
-        }
+        size_t new_count = weak_entry_referrers(entry);
+        weak_count_referrers(weak_table, old_count, new_count);
 
-        if (empty) {
+        if (new_count == 0) {
             weak_entry_remove(weak_table, entry);
         }
     }
@@ -433,12 +569,15 @@ weak_register_no_lock(weak_table_t *weak_table, id referent_id,
     // now remember it and where it is being stored
     weak_entry_t *entry;
     if ((entry = weak_entry_for_referent(weak_table, referent))) {
+        size_t old_count = weak_entry_referrers(entry);
         append_referrer(entry, referrer);
+        weak_count_referrers(weak_table, old_count, old_count + 1);
     } 
     else {
         weak_entry_t new_entry(referent, referrer);
         weak_grow_maybe(weak_table);
         weak_entry_insert(weak_table, &new_entry);
+        weak_count_referrers(weak_table, 0, 1);
     }
 
     // Do not set *referrer. objc_storeWeak() requires that the 
@@ -476,22 +615,35 @@ weak_clear_no_lock(weak_table_t *weak_table, id referent_id)
         return;
     }
 
+    uint64_t start = slowpath(ProfileWeakClears) ? nanoseconds() : 0;
+
     // zero out references
     weak_referrer_t *referrers;
     size_t count;
+    size_t remaining;
     
     if (entry->out_of_line()) {
         referrers = entry->referrers;
         count = TABLE_SIZE(entry);
+        remaining = entry->num_refs;
     } 
     else {
         referrers = entry->inline_referrers;
         count = WEAK_INLINE_COUNT;
+        remaining = WEAK_INLINE_COUNT;
     }
-    
-    for (size_t i = 0; i < count; ++i) {
-        objc_object **referrer = referrers[i];
-        if (referrer) {
+
+    // Skip empty groups with one compare, and stop as soon as every
+    // referrer has been seen.
+    weak_group_t empty = weak_group_splat(nil);
+    for (size_t g = 0; g < count && remaining > 0; g += WEAK_GROUP_SIZE) {
+        weak_group_mask_t used = (weak_group_load(&referrers[g]) != empty);
+        if (!weak_group_any(used)) continue;
+
+        for (size_t i = g; i < g + WEAK_GROUP_SIZE; ++i) {
+            objc_object **referrer = referrers[i];
+            if (!referrer) continue;
+            remaining--;
             if (*referrer == referent) {
                 *referrer = nil;
             }
@@ -504,6 +656,92 @@ weak_clear_no_lock(weak_table_t *weak_table, id referent_id)
         }
     }
     
+    weak_count_referrers(weak_table, weak_entry_referrers(entry), 0);
     weak_entry_remove(weak_table, entry);
+
+    weak_table->clear_count++;
+    if (slowpath(ProfileWeakClears)) {
+        uint64_t elapsed = nanoseconds() - start;
+        weak_table->clear_nanoseconds += elapsed;
+        if (elapsed > weak_table->max_clear_nanoseconds) {
+            weak_table->max_clear_nanoseconds = elapsed;
+        }
+    }
+}
+
+
+/***********************************************************************
+* Hazard pointers for lock-free weak loads
+**********************************************************************/
+
+static explicit_atomic<weak_hazard_t *> weak_hazards{nil};
+explicit_atomic<uintptr_t> weak_hazard_readers{0};
+tls_direct(weak_hazard_t *, tls_key::weak_hazard) weak_hazard_tls;
+
+weak_hazard_t *
+weak_hazard_for_thread_slow(void)
+{
+    _objc_pthread_data *data = _objc_fetch_pthread_data(true);
+    if (!data) return nil;
+    if (data->weakHazard) {
+        weak_hazard_tls = data->weakHazard;
+        return data->weakHazard;
+    }
+
+    // Reuse a record left behind by an exited thread.
+    weak_hazard_t *hazard = weak_hazards.load(std::memory_order_acquire);
+    for ( ; hazard; hazard = hazard->next) {
+        bool expected = false;
+        if (hazard->inUse.compare_exchange_strong(expected, true,
+                                                  std::memory_order_relaxed))
+            break;
+    }
+
+    if (!hazard) {
+        hazard = new weak_hazard_t;
+        hazard->inUse.store(true, std::memory_order_relaxed);
+        weak_hazard_t *head = weak_hazards.load(std::memory_order_relaxed);
+        do {
+            hazard->next = head;
+        } while (!weak_hazards.compare_exchange_weak(head, hazard,
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed));
+    }
+
+    data->weakHazard = hazard;
+    weak_hazard_tls = hazard;
+    return hazard;
 }
 
+void
+weak_hazard_destroy(weak_hazard_t *hazard)
+{
+    if (!hazard) return;
+    // Runs on the exiting thread. A later load on this thread must not
+    // use the record once another thread can claim it.
+    weak_hazard_tls = nil;
+    hazard->referent.store(nil, std::memory_order_relaxed);
+    hazard->inUse.store(false, std::memory_order_release);
+}
+
+void
+weak_wait_for_readers(objc_object *referent)
+{
+    weak_hazard_t *hazard = weak_hazards.load(std::memory_order_acquire);
+    if (!hazard) return;
+
+    // Pairs with the seq_cst hazard store and weak variable reload in
+    // objc_loadWeakRetained(). Either the reader sees the cleared weak
+    // variable and backs off, or we see its hazard here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // No reader is between weak_hazard_enter() and weak_hazard_leave(),
+    // and any that enters from here on re-reads the cleared variable.
+    if (weak_hazard_readers.load(std::memory_order_relaxed) == 0) return;
+
+    for ( ; hazard; hazard = hazard->next) {
+        while (hazard->referent.load(std::memory_order_acquire) == referent) {
+            sched_yield();
+        }
+    }
+}
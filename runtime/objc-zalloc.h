@@ -65,7 +65,7 @@ class AtomicQueue {
     };
 
 public:
-    AtomicQueue() : pair(0) {}
+    constexpr AtomicQueue() : pair(0) {}
 
     void *pop();
     void push_list(void *_head, void *_tail);
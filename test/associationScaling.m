@@ -0,0 +1,75 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+// associated object benchmark
+// Each thread sets, gets, and removes associations on its own objects,
+// at 1 to THREADS threads. The association table is striped by object
+// address, so threads working on different objects rarely share a lock.
+
+#if defined(__arm__)
+#define THREADS 8
+#else
+#define THREADS 32
+#endif
+#define OBJECTS 64
+#define COUNT 1024*4
+
+static char key1;
+static char key2;
+
+static void *threadfn(void *arg __unused)
+{
+    id objects[OBJECTS];
+    id value = [NSObject new];
+    for (int i = 0; i < OBJECTS; i++) {
+        objects[i] = [NSObject new];
+    }
+
+    for (int n = 0; n < COUNT; n++) {
+        id obj = objects[n % OBJECTS];
+        objc_setAssociatedObject(obj, &key1, value, OBJC_ASSOCIATION_RETAIN);
+        objc_setAssociatedObject(obj, &key2, obj, OBJC_ASSOCIATION_ASSIGN);
+        testassert(objc_getAssociatedObject(obj, &key1) == value);
+        testassert(objc_getAssociatedObject(obj, &key2) == obj);
+        if (n % 3 == 0) {
+            objc_removeAssociatedObjects(obj);
+            testassert(objc_getAssociatedObject(obj, &key1) == nil);
+        }
+    }
+
+    for (int i = 0; i < OBJECTS; i++) {
+        [objects[i] release];
+    }
+    testassertequal([value retainCount], 1);
+    [value release];
+    return NULL;
+}
+
+static uint64_t run(int count)
+{
+    pthread_t threads[THREADS];
+    uint64_t start = hires_time();
+    for (int t = 0; t < count; t++) {
+        pthread_create(&threads[t], NULL, threadfn, NULL);
+    }
+    for (int t = 0; t < count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return hires_time() - start;
+}
+
+int main()
+{
+    for (int threads = 1; threads <= THREADS; threads *= 2) {
+        uint64_t time = run(threads);
+        testprintf("%2d threads: %llu ns/iteration\n", threads,
+                   time / ((uint64_t)threads*COUNT));
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,126 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+// associated object size benchmark
+// An object's first few associations are stored in a small array; more
+// than that moves them to a hash table. Either one is allocated apart from
+// the association table's bucket. Check that both representations and the
+// switch between them behave the same, and report memory and lookup time
+// at 1, 2, 4, and 32 associations per object.
+
+#define OBJECTS 4096
+#define MAXKEYS 32
+#define LOOKUPS 16
+
+static char keys[MAXKEYS];
+static int deallocs;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+static void setCounted(id obj, int k)
+{
+    id value = [Counted new];
+    objc_setAssociatedObject(obj, &keys[k], value, OBJC_ASSOCIATION_RETAIN);
+    [value release];
+}
+
+// The getter autoreleases retained values. Don't let the pool
+// keep them alive.
+static bool hasAssociation(id obj, int k)
+{
+    @autoreleasepool {
+        return objc_getAssociatedObject(obj, &keys[k]) != nil;
+    }
+}
+
+static void measure(id *objects, int nkeys)
+{
+    size_t before = leak_inuse();
+    for (int i = 0; i < OBJECTS; i++) {
+        for (int k = 0; k < nkeys; k++) {
+            objc_setAssociatedObject(objects[i], &keys[k], objects[i],
+                                     OBJC_ASSOCIATION_ASSIGN);
+        }
+    }
+    size_t after = leak_inuse();
+
+    uint64_t start = hires_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        for (int i = 0; i < OBJECTS; i++) {
+            testassert(objc_getAssociatedObject(objects[i], &keys[n % nkeys])
+                       == objects[i]);
+        }
+    }
+    uint64_t lookupTime = hires_time() - start;
+
+    for (int i = 0; i < OBJECTS; i++) {
+        objc_removeAssociatedObjects(objects[i]);
+    }
+
+    testprintf("%2d associations: %zu bytes/object, %llu ns/lookup\n",
+               nkeys, after > before ? (after - before) / OBJECTS : 0,
+               lookupTime / ((uint64_t)LOOKUPS * OBJECTS));
+}
+
+int main()
+{
+    // Grow from the small array to a hash table and back down.
+    id obj = [NSObject new];
+    for (int k = 0; k < MAXKEYS; k++) {
+        setCounted(obj, k);
+        for (int j = 0; j <= k; j++) {
+            testassert(hasAssociation(obj, j));
+        }
+    }
+    for (int k = MAXKEYS - 1; k >= 0; k--) {
+        objc_setAssociatedObject(obj, &keys[k], nil, OBJC_ASSOCIATION_ASSIGN);
+        testassert(!hasAssociation(obj, k));
+        for (int j = 0; j < k; j++) {
+            testassert(hasAssociation(obj, j));
+        }
+    }
+
+    // Removing a small-array association keeps the other one.
+    deallocs = 0;
+    setCounted(obj, 0);
+    setCounted(obj, 1);
+    objc_setAssociatedObject(obj, &keys[0], nil, OBJC_ASSOCIATION_ASSIGN);
+    testassertequal(deallocs, 1);
+    testassert(hasAssociation(obj, 1));
+
+    // Replacing a value releases the old one.
+    setCounted(obj, 1);
+    testassertequal(deallocs, 2);
+
+    // Deallocation releases everything, in the small array or not.
+    for (int k = 2; k < MAXKEYS; k++) {
+        setCounted(obj, k);
+    }
+    [obj release];
+    testassertequal(deallocs, 2 + MAXKEYS - 1);
+
+    id *objects = (id *)malloc(OBJECTS * sizeof(id));
+    for (int i = 0; i < OBJECTS; i++) {
+        objects[i] = [NSObject new];
+    }
+    measure(objects, 1);
+    measure(objects, 2);
+    measure(objects, 4);
+    measure(objects, 32);
+    for (int i = 0; i < OBJECTS; i++) {
+        [objects[i] release];
+    }
+    free(objects);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,117 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <pthread.h>
+#include <objc/runtime.h>
+#import <objc/NSObject.h>
+
+// atomic property benchmark
+// Many threads read one atomic object property while one thread keeps
+// replacing its value. Getters don't take the property's lock; run with
+// OBJC_DISABLE_OPTIMISTIC_PROPERTY_READS=YES to compare against locking.
+
+#if defined(__arm__)
+#define THREADS 8
+#else
+#define THREADS 32
+#endif
+#define COUNT 1024*16
+
+static atomic_int deallocs;
+static atomic_bool stop;
+
+@interface Value : NSObject {
+@public
+    int check;
+}
+@end
+@implementation Value
+-(id)init {
+    self = [super init];
+    check = 42;
+    return self;
+}
+-(void)dealloc {
+    check = 0;
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+@interface TestAtomicProperty : NSObject {
+    id value;
+}
+@property(atomic, retain) id value;
+@end
+
+@implementation TestAtomicProperty
+@synthesize value;
+@end
+
+static TestAtomicProperty *test;
+
+static void *readerfn(void *arg __unused)
+{
+    for (int i = 0; i < COUNT; i++) {
+        PUSH_POOL {
+            Value *v = test.value;
+            testassert(v);
+            testassertequal(v->check, 42);
+        } POP_POOL;
+    }
+    return NULL;
+}
+
+static void *writerfn(void *arg __unused)
+{
+    while (!stop) {
+        Value *v = [Value new];
+        test.value = v;
+        [v release];
+    }
+    return NULL;
+}
+
+static uint64_t run(int count, bool write)
+{
+    pthread_t threads[THREADS];
+    pthread_t writer;
+    stop = false;
+    if (write) pthread_create(&writer, NULL, writerfn, NULL);
+    uint64_t start = hires_time();
+    for (int t = 0; t < count; t++) {
+        pthread_create(&threads[t], NULL, readerfn, NULL);
+    }
+    for (int t = 0; t < count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    uint64_t time = hires_time() - start;
+    stop = true;
+    if (write) pthread_join(writer, NULL);
+    return time;
+}
+
+int main()
+{
+    test = [TestAtomicProperty new];
+    Value *v = [Value new];
+    test.value = v;
+    [v release];
+
+    for (int threads = 1; threads <= THREADS; threads *= 2) {
+        uint64_t readTime = run(threads, false);
+        uint64_t writeTime = run(threads, true);
+        testprintf("%2d readers: %llu ns/get, %llu ns/get with a writer\n",
+                   threads,
+                   readTime / ((uint64_t)threads*COUNT),
+                   writeTime / ((uint64_t)threads*COUNT));
+    }
+
+    // Every replaced value was freed, and only the current one is left.
+    int replaced = deallocs;
+    test.value = nil;
+    testassertequal(deallocs, replaced + 1);
+    [test release];
+
+    succeed(__FILE__);
+}
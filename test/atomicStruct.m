@@ -0,0 +1,104 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <pthread.h>
+#import <objc/NSObject.h>
+
+// Atomic struct properties of every size must never be read torn while
+// other threads write them. Sizes and alignments that fit one atomic
+// instruction, seqlock-sized structs, and structs too large for either
+// take different paths through objc_copyStruct().
+
+#define READERS 4
+#define WRITERS 2
+#define COUNT 1024*32
+
+typedef struct { int32_t a, b; } Small;            // 8 bytes, 4-aligned
+typedef struct { int64_t a, b; } Pair;             // 16 bytes
+typedef struct { int64_t a, b, c; } Triple;        // 24 bytes
+typedef struct { int64_t v[8]; } Medium;           // 64 bytes
+typedef struct { int64_t v[32]; } Large;           // 256 bytes
+
+@interface TestAtomicStruct : NSObject {
+    char pad;
+    Small small;
+    Pair pair;
+    Triple triple;
+    Medium medium;
+    Large large;
+}
+@property(atomic) Small small;
+@property(atomic) Pair pair;
+@property(atomic) Triple triple;
+@property(atomic) Medium medium;
+@property(atomic) Large large;
+@end
+
+@implementation TestAtomicStruct
+@synthesize small, pair, triple, medium, large;
+@end
+
+static TestAtomicStruct *test;
+
+static void *writerfn(void *arg)
+{
+    int64_t base = (int64_t)(intptr_t)arg * COUNT;
+    for (int64_t i = 0; i < COUNT; i++) {
+        int64_t n = base + i;
+        test.small = (Small){ (int32_t)n, (int32_t)n };
+        test.pair = (Pair){ n, n };
+        test.triple = (Triple){ n, n, n };
+        Medium m;
+        for (int j = 0; j < 8; j++) m.v[j] = n;
+        test.medium = m;
+        Large l;
+        for (int j = 0; j < 32; j++) l.v[j] = n;
+        test.large = l;
+    }
+    return NULL;
+}
+
+static void *readerfn(void *arg __unused)
+{
+    for (int i = 0; i < COUNT; i++) {
+        Small s = test.small;
+        testassertequal(s.a, s.b);
+        Pair p = test.pair;
+        testassertequal(p.a, p.b);
+        Triple t = test.triple;
+        testassertequal(t.a, t.b);
+        testassertequal(t.a, t.c);
+        Medium m = test.medium;
+        for (int j = 1; j < 8; j++) testassertequal(m.v[j], m.v[0]);
+        Large l = test.large;
+        for (int j = 1; j < 32; j++) testassertequal(l.v[j], l.v[0]);
+    }
+    return NULL;
+}
+
+int main()
+{
+    test = [TestAtomicStruct new];
+
+    pthread_t readers[READERS];
+    pthread_t writers[WRITERS];
+    uint64_t start = hires_time();
+    for (int t = 0; t < WRITERS; t++) {
+        pthread_create(&writers[t], NULL, writerfn, (void *)(intptr_t)t);
+    }
+    for (int t = 0; t < READERS; t++) {
+        pthread_create(&readers[t], NULL, readerfn, NULL);
+    }
+    for (int t = 0; t < READERS; t++) {
+        pthread_join(readers[t], NULL);
+    }
+    for (int t = 0; t < WRITERS; t++) {
+        pthread_join(writers[t], NULL);
+    }
+    testprintf("%d readers, %d writers: %llu ns per read of all five\n",
+               READERS, WRITERS,
+               (hires_time() - start) / ((uint64_t)READERS * COUNT));
+
+    [test release];
+    succeed(__FILE__);
+}
@@ -0,0 +1,142 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+
+// imp_implementationWithBlock benchmark
+// Trampolines are taken from per-page-group free lists without locking,
+// and an IMP's page group is found through an address-indexed map.
+// Measure create, lookup, and remove throughput with many live IMPs,
+// one at a time and with imp_implementationWithBlocks, and check that
+// concurrent threads never get the same trampoline.
+
+#define COUNT 20000
+#define THREADS 4
+#define THREAD_COUNT 4096
+
+typedef uintptr_t (*Func)(id, SEL);
+
+static id makeBlock(uintptr_t value)
+{
+    return [^(id self __unused) { return value; } copy];
+}
+
+static void checkAll(IMP *imps, id *blocks, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) {
+        testassert(imp_getBlock(imps[i]) == blocks[i]);
+        testassertequal(((Func)imps[i])(nil, NULL), (uintptr_t)i);
+    }
+}
+
+static IMP *sharedImps;
+static atomic_int removed;
+
+// Every thread removes every shared IMP. Each must succeed exactly once.
+static void *removefn(void *arg __unused)
+{
+    for (unsigned i = 0; i < THREAD_COUNT; i++) {
+        if (imp_removeBlock(sharedImps[i])) removed++;
+    }
+    return NULL;
+}
+
+static void *threadfn(void *arg __unused)
+{
+    IMP *imps = (IMP *)malloc(THREAD_COUNT * sizeof(IMP));
+    for (int round = 0; round < 4; round++) {
+        for (unsigned i = 0; i < THREAD_COUNT; i++) {
+            id block = makeBlock(i);
+            imps[i] = imp_implementationWithBlock(block);
+            [block release];
+        }
+        for (unsigned i = 0; i < THREAD_COUNT; i++) {
+            testassertequal(((Func)imps[i])(nil, NULL), (uintptr_t)i);
+        }
+        for (unsigned i = 0; i < THREAD_COUNT; i++) {
+            testassert(imp_removeBlock(imps[i]));
+        }
+    }
+    free(imps);
+    return NULL;
+}
+
+int main()
+{
+    IMP *imps = (IMP *)malloc(COUNT * sizeof(IMP));
+    id *blocks = (id *)malloc(COUNT * sizeof(id));
+    for (unsigned i = 0; i < COUNT; i++) {
+        blocks[i] = makeBlock(i);
+    }
+
+    uint64_t start = hires_time();
+    for (unsigned i = 0; i < COUNT; i++) {
+        imps[i] = imp_implementationWithBlock(blocks[i]);
+    }
+    uint64_t createTime = hires_time() - start;
+
+    // Non-copying blocks are the same object after Block_copy.
+    checkAll(imps, blocks, COUNT);
+
+    start = hires_time();
+    for (unsigned i = 0; i < COUNT; i++) {
+        testassert(imp_getBlock(imps[i]));
+    }
+    uint64_t lookupTime = hires_time() - start;
+
+    start = hires_time();
+    for (unsigned i = 0; i < COUNT; i++) {
+        testassert(imp_removeBlock(imps[i]));
+    }
+    uint64_t removeTime = hires_time() - start;
+
+    // Removed IMPs have no block and can't be removed again.
+    testassert(imp_getBlock(imps[0]) == nil);
+    testassert(!imp_removeBlock(imps[0]));
+    testassert(imp_getBlock((IMP)main) == nil);
+    testassert(!imp_removeBlock((IMP)main));
+
+    start = hires_time();
+    imp_implementationWithBlocks(blocks, imps, COUNT);
+    uint64_t bulkTime = hires_time() - start;
+    checkAll(imps, blocks, COUNT);
+    for (unsigned i = 0; i < COUNT; i++) {
+        testassert(imp_removeBlock(imps[i]));
+    }
+
+    testprintf("%d IMPs: create %llu ns, bulk create %llu ns, "
+               "imp_getBlock %llu ns, remove %llu ns\n", COUNT,
+               createTime / COUNT, bulkTime / COUNT,
+               lookupTime / COUNT, removeTime / COUNT);
+
+    pthread_t threads[THREADS];
+    start = hires_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, threadfn, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    testprintf("%d threads: %llu ns per create and remove\n", THREADS,
+               (hires_time() - start) / (THREADS * 4 * THREAD_COUNT));
+
+    sharedImps = imps;
+    imp_implementationWithBlocks(blocks, imps, THREAD_COUNT);
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, removefn, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    testassertequal(removed, THREAD_COUNT);
+
+    for (unsigned i = 0; i < COUNT; i++) {
+        [blocks[i] release];
+    }
+    free(blocks);
+    free(imps);
+    succeed(__FILE__);
+}
@@ -0,0 +1,93 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+#include <objc/NSObject.h>
+
+// class_createInstances() benchmark
+// Batch creation gets its objects from malloc in as few calls as it can
+// and sets every isa in one pass. The objects must be indistinguishable
+// from ones made by class_createInstance(): zero-filled, with working
+// retain counts, and freed normally.
+
+#define OBJECTS 20000
+#define EXTRA 16
+
+static int deallocs;
+
+@interface Decoded : NSObject {
+@public
+    long a, b, c;
+}
+@end
+@implementation Decoded
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+static unsigned createAll(id *objects)
+{
+    unsigned count = 0;
+    while (count < OBJECTS) {
+        unsigned n = class_createInstances([Decoded class], EXTRA,
+                                           objects + count, OBJECTS - count);
+        testassert(n > 0);
+        count += n;
+    }
+    return count;
+}
+
+int main()
+{
+    id *objects = (id *)malloc(OBJECTS * sizeof(id));
+    size_t size = class_getInstanceSize([Decoded class]) + EXTRA;
+
+    // Dirty the heap so that reused blocks would show through.
+    for (int i = 0; i < OBJECTS; i++) {
+        objects[i] = (id)malloc(size);
+        memset(objects[i], 0xaa, size);
+    }
+    for (int i = 0; i < OBJECTS; i++) {
+        free(objects[i]);
+    }
+
+    uint64_t start = hires_time();
+    createAll(objects);
+    uint64_t batchTime = hires_time() - start;
+
+    for (int i = 0; i < OBJECTS; i++) {
+        Decoded *obj = objects[i];
+        testassert(object_getClass(obj) == [Decoded class]);
+        testassert(obj->a == 0  &&  obj->b == 0  &&  obj->c == 0);
+        char *extra = (char *)object_getIndexedIvars(obj);
+        for (int j = 0; j < EXTRA; j++) testassert(extra[j] == 0);
+        [obj retain];
+        testassertequal([obj retainCount], 2);
+        [obj release];
+    }
+    deallocs = 0;
+    for (int i = 0; i < OBJECTS; i++) {
+        [objects[i] release];
+    }
+    testassertequal(deallocs, OBJECTS);
+
+    start = hires_time();
+    for (int i = 0; i < OBJECTS; i++) {
+        objects[i] = class_createInstance([Decoded class], EXTRA);
+    }
+    uint64_t singleTime = hires_time() - start;
+    for (int i = 0; i < OBJECTS; i++) {
+        [objects[i] release];
+    }
+
+    testprintf("%d objects: class_createInstances %llu ns/object, "
+               "class_createInstance %llu ns/object\n", OBJECTS,
+               batchTime / OBJECTS, singleTime / OBJECTS);
+
+    free(objects);
+    succeed(__FILE__);
+}
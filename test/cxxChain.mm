@@ -0,0 +1,86 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+// C++ ivar construction benchmark
+// Each class with C++ ivars keeps a flat list of the .cxx_construct and
+// .cxx_destruct IMPs for its instances. Check that they still run in
+// order across several levels, including a level without C++ ivars, and
+// that replacing a .cxx_destruct takes effect.
+
+#define OBJECTS 100000
+
+static int order[16];
+static int orderCount;
+static int replacedDtors;
+
+template <int N>
+class Recorder {
+  public:
+    Recorder() { order[orderCount++] = N; }
+    ~Recorder() { order[orderCount++] = -N; }
+};
+
+@interface Level1 : NSObject { Recorder<1> r1; } @end
+@implementation Level1 @end
+@interface Level2 : Level1 { Recorder<2> r2; } @end
+@implementation Level2 @end
+@interface Level3 : Level2 { int plain; } @end
+@implementation Level3 @end
+@interface Level4 : Level3 { Recorder<4> r4; } @end
+@implementation Level4 @end
+@interface Level5 : Level4 { Recorder<5> r5; } @end
+@implementation Level5 @end
+
+static void (*originalDtor)(id, SEL);
+static void replacementDtor(id self, SEL _cmd)
+{
+    replacedDtors++;
+    originalDtor(self, _cmd);
+}
+
+static void checkOrder(void)
+{
+    static const int expected[] = { 1, 2, 4, 5, -5, -4, -2, -1 };
+    orderCount = 0;
+    [[Level5 new] release];
+    testassertequal(orderCount, 8);
+    for (int i = 0; i < 8; i++) {
+        testassertequal(order[i], expected[i]);
+    }
+}
+
+int main()
+{
+    checkOrder();
+
+    // Replacing a .cxx_destruct drops the chains that use it.
+    Method m = class_getInstanceMethod([Level2 class],
+                                       sel_registerName(".cxx_destruct"));
+    testassert(m);
+    originalDtor = (void (*)(id, SEL))
+        method_setImplementation(m, (IMP)replacementDtor);
+    replacedDtors = 0;
+    checkOrder();
+    testassertequal(replacedDtors, 1);
+    orderCount = 0;
+    [[Level2 new] release];
+    testassertequal(replacedDtors, 2);
+    method_setImplementation(m, (IMP)originalDtor);
+    replacedDtors = 0;
+    checkOrder();
+    testassertequal(replacedDtors, 0);
+
+    uint64_t start = hires_time();
+    for (int i = 0; i < OBJECTS; i++) {
+        orderCount = 0;
+        [[Level5 new] release];
+    }
+    uint64_t time = hires_time() - start;
+    testprintf("5 levels: %llu ns per alloc and dealloc\n", time / OBJECTS);
+
+    succeed(__FILE__);
+}
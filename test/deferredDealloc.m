@@ -0,0 +1,146 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <objc/NSObject.h>
+#include <stdlib.h>
+
+// Objects of a class marked with _class_setDeferredDeallocation are destroyed
+// on a background thread. Weak references must still read as nil as soon as
+// the final release returns.
+
+#define GRAPHS 200
+#define CHILDREN 200
+
+static pthread_t mainThread;
+static atomic_int childDeallocs;
+static atomic_int childDeallocsOffMain;
+
+@interface Child : NSObject @end
+@implementation Child
+-(void)dealloc {
+    if (!pthread_equal(pthread_self(), mainThread)) childDeallocsOffMain++;
+    childDeallocs++;
+    [super dealloc];
+}
+@end
+
+@interface Graph : NSObject @end
+@implementation Graph @end
+
+@interface DeferredGraph : Graph @end
+@implementation DeferredGraph @end
+
+@interface DeferredGraphSub : DeferredGraph @end
+@implementation DeferredGraphSub @end
+
+@interface ForkDeferredGraph : Graph @end
+@implementation ForkDeferredGraph @end
+
+static char childKeys[CHILDREN];
+
+static id makeGraph(Class cls)
+{
+    id obj = [cls new];
+    for (int i = 0; i < CHILDREN; i++) {
+        id child = [Child new];
+        objc_setAssociatedObject(obj, &childKeys[i], child, OBJC_ASSOCIATION_RETAIN);
+        [child release];
+    }
+    return obj;
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+    uint64_t lhs = *(const uint64_t *)a, rhs = *(const uint64_t *)b;
+    return lhs < rhs ? -1 : lhs > rhs;
+}
+
+// Release GRAPHS object graphs and return the 99th percentile release time.
+static uint64_t releaseLatencyP99(Class cls)
+{
+    static uint64_t times[GRAPHS];
+    for (int i = 0; i < GRAPHS; i++) {
+        id obj = makeGraph(cls);
+        id weakVar = nil;
+        objc_storeWeak(&weakVar, obj);
+
+        uint64_t start = mach_absolute_time();
+        [obj release];
+        times[i] = mach_absolute_time() - start;
+
+        testassert(objc_loadWeak(&weakVar) == nil);
+        objc_destroyWeak(&weakVar);
+    }
+
+    qsort(times, GRAPHS, sizeof(times[0]), compareTimes);
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    return times[GRAPHS * 99 / 100] * tb.numer / tb.denom;
+}
+
+static void waitForChildDeallocs(int expected)
+{
+    for (int i = 0; i < 10000 && childDeallocs < expected; i++) {
+        usleep(1000);
+    }
+    testassertequal(childDeallocs, expected);
+}
+
+int main()
+{
+    mainThread = pthread_self();
+
+    // Synchronous baseline.
+    uint64_t inlineP99 = releaseLatencyP99([Graph class]);
+    testassertequal(childDeallocs, GRAPHS * CHILDREN);
+    testassertequal(childDeallocsOffMain, 0);
+
+    // Realize the subclass first to check propagation to existing subclasses.
+    [[DeferredGraphSub new] release];
+    _class_setDeferredDeallocation([DeferredGraph class]);
+
+    childDeallocs = 0;
+    uint64_t deferredP99 = releaseLatencyP99([DeferredGraph class]);
+    waitForChildDeallocs(GRAPHS * CHILDREN);
+    testassertequal(childDeallocsOffMain, GRAPHS * CHILDREN);
+
+    childDeallocs = 0;
+    childDeallocsOffMain = 0;
+    releaseLatencyP99([DeferredGraphSub class]);
+    waitForChildDeallocs(GRAPHS * CHILDREN);
+    testassertequal(childDeallocsOffMain, GRAPHS * CHILDREN);
+
+    // The superclass is unaffected.
+    childDeallocs = 0;
+    childDeallocsOffMain = 0;
+    releaseLatencyP99([Graph class]);
+    testassertequal(childDeallocs, GRAPHS * CHILDREN);
+    testassertequal(childDeallocsOffMain, 0);
+
+    // A forked child has no background thread. Opting in there starts
+    // a new one instead of queueing objects that nothing destroys.
+    pid_t child = fork();
+    if (child < 0) fail("fork failed (errno %d %s)", errno, strerror(errno));
+    if (child == 0) {
+        mainThread = pthread_self();
+        _class_setDeferredDeallocation([ForkDeferredGraph class]);
+        childDeallocs = 0;
+        childDeallocsOffMain = 0;
+        releaseLatencyP99([ForkDeferredGraph class]);
+        waitForChildDeallocs(GRAPHS * CHILDREN);
+        testassertequal(childDeallocsOffMain, GRAPHS * CHILDREN);
+        _exit(0);
+    }
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fail("waitpid failed (errno %d %s)", errno, strerror(errno));
+        }
+    }
+    testassert(WIFEXITED(status)  &&  WEXITSTATUS(status) == 0);
+
+    // The point of deferring: the releasing thread's worst cases shrink.
+    timecheck("deferred release p99 (ns)", deferredP99, 0, inlineP99);
+
+    succeed(__FILE__);
+}
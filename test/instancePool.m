@@ -0,0 +1,150 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/objc-internal.h>
+#include <objc/NSObject.h>
+
+// Instances of classes marked with _class_setPooledInstances() recycle
+// their memory. Reused memory must look freshly allocated, weak references
+// and associated objects must still be cleared, and subclasses are pooled
+// too. Also compares churn time against an unpooled class.
+
+#define OBJECTS 10000
+#define THREADS 8
+
+static int deallocs;
+static char assocKey;
+
+@interface Pooled : NSObject {
+@public
+    long a, b;
+}
+@end
+@implementation Pooled
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+@interface PooledSub : Pooled @end
+@implementation PooledSub @end
+
+@interface Unpooled : NSObject {
+    long a, b;
+}
+@end
+@implementation Unpooled @end
+
+static void *churnfn(void *arg)
+{
+    Class cls = (__bridge Class)arg;
+    for (int i = 0; i < OBJECTS; i++) {
+        [[cls new] release];
+    }
+    return NULL;
+}
+
+static uint64_t churn(Class cls)
+{
+    pthread_t threads[THREADS];
+    uint64_t start = hires_time();
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, churnfn, (__bridge void *)cls);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return hires_time() - start;
+}
+
+int main()
+{
+    _class_setPooledInstances([Pooled class]);
+
+    objc_instance_pool_statistics_t before, after;
+    _objc_getInstancePoolStatistics(&before);
+
+#if _MALLOC_TYPE_ENABLED
+    // Typed malloc turns pooling off.
+    [[Pooled new] release];
+    _objc_getInstancePoolStatistics(&after);
+    testassertequal(after.allocations, before.allocations);
+    testassertequal(after.frees, before.frees);
+    succeed(__FILE__);
+#endif
+
+    // Reused memory is zeroed and has the new object's class.
+    Pooled *obj = [Pooled new];
+    obj->a = 1;
+    obj->b = 2;
+    void *address = obj;
+    [obj release];
+    PooledSub *sub = [PooledSub new];
+    testassert((void *)sub == address);
+    testassert(object_getClass(sub) == [PooledSub class]);
+    testassert(sub->a == 0  &&  sub->b == 0);
+    testassertequal([sub retainCount], 1);
+
+    // Weak references and associated objects are cleared first.
+    id weak = nil;
+    objc_storeWeak(&weak, sub);
+    id value = [NSObject new];
+    objc_setAssociatedObject(sub, &assocKey, value, OBJC_ASSOCIATION_RETAIN);
+    testassertequal([value retainCount], 2);
+    deallocs = 0;
+    [sub release];
+    testassertequal(deallocs, 1);
+    testassert(objc_loadWeak(&weak) == nil);
+    testassertequal([value retainCount], 1);
+    [value release];
+    obj = [Pooled new];
+    testassert(objc_getAssociatedObject(obj, &assocKey) == nil);
+    [obj release];
+
+    _objc_getInstancePoolStatistics(&after);
+    testassertequal(after.allocations - before.allocations, 3);
+    testassertequal(after.hits - before.hits, 2);
+    testassertequal(after.frees - before.frees, 3);
+    testassert(after.retainedBytes > 0);
+
+    // Subclasses created at runtime, as KVO does, are pooled too.
+    Class dynamic = objc_allocateClassPair([Pooled class], "PooledDynamic", 0);
+    objc_registerClassPair(dynamic);
+    _objc_getInstancePoolStatistics(&before);
+    obj = [dynamic new];
+    testassert(object_getClass(obj) == dynamic);
+    [obj release];
+    _objc_getInstancePoolStatistics(&after);
+    testassertequal(after.allocations - before.allocations, 1);
+    testassertequal(after.frees - before.frees, 1);
+
+    // Unmarked classes don't touch the pools.
+    _objc_getInstancePoolStatistics(&before);
+    [[Unpooled new] release];
+    _objc_getInstancePoolStatistics(&after);
+    testassertequal(after.allocations, before.allocations);
+    testassertequal(after.frees, before.frees);
+
+    // Other threads' counts arrive when they exit.
+    uint64_t unpooledTime = churn([Unpooled class]);
+    _objc_getInstancePoolStatistics(&before);
+    uint64_t pooledTime = churn([Pooled class]);
+    _objc_getInstancePoolStatistics(&after);
+    uint64_t allocations = after.allocations - before.allocations;
+    uint64_t hits = after.hits - before.hits;
+    testassertequal(allocations, THREADS * OBJECTS);
+    testassertequal(after.frees - before.frees, THREADS * OBJECTS);
+    testassert(hits >= allocations - THREADS);
+
+    testprintf("%d threads: unpooled %llu ns/object, pooled %llu ns/object, "
+               "hit rate %llu%%, %llu bytes retained\n", THREADS,
+               unpooledTime / (THREADS * OBJECTS),
+               pooledTime / (THREADS * OBJECTS),
+               hits * 100 / allocations, after.retainedBytes);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,59 @@
+/*
+TEST_CONFIG MEM=mrc OS=!exclavekit
+TEST_ENV OBJC_PROFILE_LOAD_METHODS=YES
+
+TEST_RUN_OUTPUT
+(objc\[\d+\]: LOAD: .*\n)*objc\[\d+\]: LOAD: 3 \+load methods took \d+ us \(\d+ us CPU\)
+objc\[\d+\]: LOAD: +\d+ us +\d+ us CPU  \+\[Slow load\]  .*loadProfile.*
+objc\[\d+\]: LOAD: +\d+ us +\d+ us CPU  \+\[Fast\(Medium\) load\]  .*loadProfile.*
+objc\[\d+\]: LOAD: +\d+ us +\d+ us CPU  \+\[Fast load\]  .*loadProfile.*
+OK: loadProfile.m
+END
+
+Class and category +load methods are timed, and the report for the
+image lists them slowest first with the image that contains them.
+*/
+
+#include "test.h"
+
+static int loads;
+
+static void spin(uint64_t nanoseconds)
+{
+    uint64_t start = hires_time();
+    while (hires_time() - start < nanoseconds) { }
+}
+
+OBJC_ROOT_CLASS
+@interface Slow @end
+@implementation Slow
++(void)load
+{
+    spin(50000000);
+    loads++;
+}
+@end
+
+OBJC_ROOT_CLASS
+@interface Fast @end
+@implementation Fast
++(void)load
+{
+    loads++;
+}
+@end
+
+@interface Fast (Medium) @end
+@implementation Fast (Medium)
++(void)load
+{
+    spin(10000000);
+    loads++;
+}
+@end
+
+int main()
+{
+    testassertequal(loads, 3);
+    succeed(__FILE__);
+}
@@ -0,0 +1,121 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include "testroot.i"
+
+#include <string.h>
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+// method type encoding parsing benchmark
+// Parsed method signatures are cached per encoding string. Results
+// must match the encodings, including for a string that is freed and
+// whose address is reused for a different encoding.
+
+#define LOOKUPS 100000
+
+typedef struct {
+    const char *types;
+    unsigned count;
+    const char *args[6];
+} encoding_t;
+
+static const encoding_t encodings[] = {
+    { "v16@0:8", 2, { "@", ":" } },
+    { "@24@0:8@16", 3, { "@", ":", "@" } },
+    { "B32@0:8@16q24", 4, { "@", ":", "@", "q" } },
+    { "v48@0:8{CGRect={CGPoint=dd}{CGSize=dd}}16", 3,
+      { "@", ":", "{CGRect={CGPoint=dd}{CGSize=dd}}" } },
+    { "v32@0:8@?16^@24", 4, { "@", ":", "@?", "^@" } },
+    { "@48@0:8@\"NSString\"16r*24[4i]32Q40", 6,
+      { "@", ":", "@\"NSString\"", "r*", "[4i]", "Q" } },
+};
+#define ENCODINGS (sizeof(encodings) / sizeof(encodings[0]))
+
+static void checkEncoding(Class cls, const char *types, const encoding_t *e)
+{
+    char buf[64];
+    unsigned count = 0;
+
+    SEL sel = sel_registerName(e->types);
+    class_addMethod(cls, sel, (IMP)abort, types);
+    Method method = class_getInstanceMethod(cls, sel);
+    testassert(method);
+    testassertequal(method_getNumberOfArguments(method), e->count);
+
+    for (unsigned i = 0; i < e->count; i++) {
+        char *arg = method_copyArgumentType(method, i);
+        testassert(arg);
+        testassertequal(strcmp(arg, e->args[i]), 0);
+        free(arg);
+        method_getArgumentType(method, i, buf, sizeof(buf));
+        testassertequal(strcmp(buf, e->args[i]), 0);
+        count++;
+    }
+    testassert(method_copyArgumentType(method, e->count) == NULL);
+    testassertequal(count, e->count);
+}
+
+int main()
+{
+    for (unsigned i = 0; i < ENCODINGS; i++) {
+        checkEncoding([TestRoot class], encodings[i].types, &encodings[i]);
+    }
+
+    // Heap encodings are copied by class_addMethod and freed when the
+    // class is disposed of, so the next class's encoding may get the
+    // same address.
+    for (unsigned i = 0; i < ENCODINGS; i++) {
+        char *types = strdup(encodings[i].types);
+        Class cls = objc_allocateClassPair([TestRoot class], "Disposable", 0);
+        checkEncoding(cls, types, &encodings[i]);
+        objc_registerClassPair(cls);
+        objc_disposeClassPair(cls);
+        free(types);
+    }
+
+    Method methods[ENCODINGS];
+    for (unsigned i = 0; i < ENCODINGS; i++) {
+        methods[i] = class_getInstanceMethod
+            ([TestRoot class], sel_registerName(encodings[i].types));
+    }
+
+    char buf[64];
+    uint64_t start = hires_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        Method method = methods[n % ENCODINGS];
+        unsigned count = method_getNumberOfArguments(method);
+        method_getArgumentType(method, count - 1, buf, sizeof(buf));
+    }
+    uint64_t time = hires_time() - start;
+    testprintf("%llu ns per argument count and last argument type\n",
+               time / LOOKUPS);
+
+    // Compiled methods' encodings are in read-only image data, which is
+    // the common case. Time lookups over all of NSObject's methods.
+    unsigned instanceCount, classCount;
+    Method *instanceMethods =
+        class_copyMethodList([NSObject class], &instanceCount);
+    Method *classMethods =
+        class_copyMethodList(object_getClass([NSObject class]), &classCount);
+    unsigned total = instanceCount + classCount;
+    testassert(total > 0);
+    Method *common = (Method *)malloc(total * sizeof(Method));
+    memcpy(common, instanceMethods, instanceCount * sizeof(Method));
+    memcpy(common + instanceCount, classMethods, classCount * sizeof(Method));
+    free(instanceMethods);
+    free(classMethods);
+
+    start = hires_time();
+    for (int n = 0; n < LOOKUPS; n++) {
+        Method method = common[n % total];
+        unsigned count = method_getNumberOfArguments(method);
+        method_getArgumentType(method, count - 1, buf, sizeof(buf));
+    }
+    time = hires_time() - start;
+    testprintf("%llu ns per lookup over %u NSObject methods\n",
+               time / LOOKUPS, total);
+    free(common);
+
+    succeed(__FILE__);
+}
@@ -3,7 +3,6 @@
 #include "test.h"
 #include "testroot.i"
 #include <simd/simd.h>
-#include <time.h>
 #include <stdint.h>
 
 #if !TARGET_OS_EXCLAVEKIT
@@ -75,13 +74,6 @@
 
 @implementation Sub @end
 
-static uint64_t hires_time()
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
-    return ((uint64_t)(1000000000)) * ts.tv_sec + ts.tv_nsec;
-}
-
 int main()
 {
 
@@ -0,0 +1,63 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <objc/NSObject.h>
+#include <mach/vm_param.h>
+
+// Page count and pop time for pools of increasing size. Deep pools use
+// larger pages, so they need far fewer pages than fixed-size pages would.
+
+#define MAX_OBJECTS 1000000
+
+static int deallocs;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+static void measure(int count)
+{
+    objc_autoreleasepool_statistics_t before, after;
+
+    deallocs = 0;
+    _objc_autoreleasePoolGetStatistics(&before);
+
+    void *pool = objc_autoreleasePoolPush();
+    uint64_t start = hires_time();
+    for (int i = 0; i < count; i++) {
+        [[Counted new] autorelease];
+    }
+    uint64_t fillTime = hires_time() - start;
+
+    _objc_autoreleasePoolGetStatistics(&after);
+    uint64_t pages = after.pagesAllocated - before.pagesAllocated +
+        after.pagesReused - before.pagesReused;
+
+    start = hires_time();
+    objc_autoreleasePoolPop(pool);
+    uint64_t popTime = hires_time() - start;
+
+    testassertequal(deallocs, count);
+
+    uint64_t fixedPages = (uint64_t)count * sizeof(id) / PAGE_MIN_SIZE;
+    testprintf("%7d objects: %llu pages (%llu at fixed size), "
+               "fill %llu ns, pop %llu ns\n",
+               count, pages, fixedPages, fillTime, popTime);
+    if (count == MAX_OBJECTS) {
+        testassert(pages < fixedPages / 4);
+    }
+}
+
+int main()
+{
+    measure(100);
+    measure(10000);
+    measure(100000);
+    measure(MAX_OBJECTS);
+
+    succeed(__FILE__);
+}
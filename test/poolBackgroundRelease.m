@@ -0,0 +1,99 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+// TEST_ENV OBJC_BACKGROUND_POOL_RELEASE_THRESHOLD=1000
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// Popping a large pool hands the entries of thread-agnostic classes to a
+// background thread. Other objects are still released before the pop
+// returns, and small pools are released entirely on the calling thread.
+
+#define OBJECTS 100000
+
+static pthread_t mainThread;
+static atomic_int agnosticDeallocs;
+static atomic_int agnosticDeallocsOffMain;
+static atomic_int plainDeallocs;
+static atomic_int plainDeallocsOffMain;
+
+@interface Agnostic : NSObject @end
+@implementation Agnostic
+-(void)dealloc {
+    if (!pthread_equal(pthread_self(), mainThread)) agnosticDeallocsOffMain++;
+    agnosticDeallocs++;
+    [super dealloc];
+}
+@end
+
+@interface AgnosticSub : Agnostic @end
+@implementation AgnosticSub @end
+
+@interface Plain : NSObject @end
+@implementation Plain
+-(void)dealloc {
+    if (!pthread_equal(pthread_self(), mainThread)) plainDeallocsOffMain++;
+    plainDeallocs++;
+    [super dealloc];
+}
+@end
+
+static uint64_t popTime(Class cls, int count)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < count; i++) {
+        [[cls new] autorelease];
+    }
+    uint64_t start = hires_time();
+    objc_autoreleasePoolPop(pool);
+    return hires_time() - start;
+}
+
+static void waitForAgnosticDeallocs(int expected)
+{
+    for (int i = 0; i < 10000 && agnosticDeallocs < expected; i++) {
+        usleep(1000);
+    }
+    testassertequal(agnosticDeallocs, expected);
+}
+
+int main()
+{
+    mainThread = pthread_self();
+    _class_setThreadAgnosticDealloc([Agnostic class]);
+
+    // Below the threshold: everything is released before pop returns.
+    popTime([Agnostic class], 100);
+    testassertequal(agnosticDeallocs, 100);
+    testassertequal(agnosticDeallocsOffMain, 0);
+
+    uint64_t plainTime = popTime([Plain class], OBJECTS);
+    testassertequal(plainDeallocs, OBJECTS);
+
+    agnosticDeallocs = 0;
+    uint64_t agnosticTime = popTime([AgnosticSub class], OBJECTS);
+    waitForAgnosticDeallocs(OBJECTS);
+    testassertequal(agnosticDeallocsOffMain, OBJECTS);
+
+    // Mixed pool: only the thread-agnostic objects move.
+    agnosticDeallocs = 0;
+    agnosticDeallocsOffMain = 0;
+    plainDeallocs = 0;
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < OBJECTS; i++) {
+        [[((i % 2) ? [Agnostic class] : [Plain class]) new] autorelease];
+    }
+    objc_autoreleasePoolPop(pool);
+    testassertequal(plainDeallocs, OBJECTS / 2);
+    waitForAgnosticDeallocs(OBJECTS / 2);
+    testassertequal(agnosticDeallocsOffMain, OBJECTS / 2);
+    testassertequal(plainDeallocsOffMain, 0);
+
+    testprintf("pop of %d objects: %llu ns on the calling thread, "
+               "%llu ns with background release\n",
+               OBJECTS, plainTime, agnosticTime);
+    // The pop still walks every entry, but no longer deallocates them.
+    timecheck("background release pop latency (ns)",
+              agnosticTime, 0, plainTime);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,110 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// Popping a pool releases its entries in batches. Check that every object
+// is released exactly as many times as it was autoreleased, including
+// objects with custom RR, objects that autorelease more objects from
+// -dealloc, and inner pools that were never popped.
+
+#define OBJECTS 100000
+
+static int deallocs;
+static int customReleases;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+// Autoreleases a chain of `depth` more objects when deallocated.
+@interface Spawner : Counted {
+@public
+    int depth;
+}
+@end
+@implementation Spawner
+-(void)dealloc {
+    if (depth > 0) {
+        Spawner *next = [Spawner new];
+        next->depth = depth - 1;
+        [next autorelease];
+        [[Counted new] autorelease];
+    }
+    [super dealloc];
+}
+@end
+
+@interface CustomRelease : Counted @end
+@implementation CustomRelease
+-(oneway void)release {
+    customReleases++;
+    [super release];
+}
+@end
+
+int main()
+{
+    void *outer = objc_autoreleasePoolPush();
+
+    int expected = 0;
+    for (int i = 0; i < OBJECTS; i++) {
+        switch (i % 100) {
+        case 0: {
+            Spawner *obj = [Spawner new];
+            obj->depth = 3;
+            [obj autorelease];
+            expected += 1 + 3 * 2;
+            break;
+        }
+        case 1: {
+            // Autoreleased several times in a row, which may be coalesced.
+            id obj = [Counted new];
+            [obj retain];
+            [obj retain];
+            [obj autorelease];
+            [obj autorelease];
+            [obj autorelease];
+            expected++;
+            break;
+        }
+        case 2:
+            [[CustomRelease new] autorelease];
+            expected++;
+            break;
+        case 3:
+            // Never popped explicitly.
+            objc_autoreleasePoolPush();
+            break;
+        default:
+            [[Counted new] autorelease];
+            expected++;
+            break;
+        }
+    }
+
+    // An object outside the popped pool must survive.
+    id survivor = [[Counted new] autorelease];
+    void *inner = objc_autoreleasePoolPush();
+    for (int i = 0; i < OBJECTS; i++) {
+        [[Counted new] autorelease];
+    }
+    uint64_t start = hires_time();
+    objc_autoreleasePoolPop(inner);
+    uint64_t popTime = hires_time() - start;
+    testassertequal(deallocs, OBJECTS);
+    testassert([survivor retainCount] == 1);
+
+    deallocs = 0;
+    objc_autoreleasePoolPop(outer);
+    testassertequal(deallocs, expected + 1);
+    testassertequal(customReleases, OBJECTS / 100);
+
+    testprintf("pop of %d objects: %llu ns\n", OBJECTS, popTime);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,57 @@
+//TEST_CONFIG MEM=mrc ARCH=x86_64,arm64,arm64e
+//TEST_ENV OBJC_DISABLE_AUTORELEASE_COALESCING=NO OBJC_DISABLE_AUTORELEASE_COALESCING_LRU=NO OBJC_AUTORELEASE_COALESCING_LRU_DEPTH=16
+
+#include "test.h"
+#import <objc/NSObject.h>
+
+// With a look-back depth of 16, repeated autoreleases of 8 objects in
+// round robin order collapse into 8 pool entries. The coalesced entries
+// are counted when the pool is popped.
+
+#define OBJECTS 8
+#define ROUNDS 100
+
+static int deallocs;
+
+@interface Counted : NSObject @end
+@implementation Counted
+-(void)dealloc {
+    deallocs++;
+    [super dealloc];
+}
+@end
+
+int main()
+{
+    objc_autoreleasepool_statistics_t before, after;
+    _objc_autoreleasePoolGetStatistics(&before);
+
+    id objs[OBJECTS];
+    for (int i = 0; i < OBJECTS; i++) {
+        objs[i] = [Counted new];
+    }
+
+    void *pool = objc_autoreleasePoolPush();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < OBJECTS; i++) {
+            [objs[i] retain];
+            [objs[i] autorelease];
+        }
+    }
+    for (int i = 0; i < OBJECTS; i++) {
+        testassertequal([objs[i] retainCount], ROUNDS + 1);
+    }
+    objc_autoreleasePoolPop(pool);
+
+    _objc_autoreleasePoolGetStatistics(&after);
+    testassertequal(after.entriesCoalesced - before.entriesCoalesced,
+                    OBJECTS * (ROUNDS - 1));
+
+    for (int i = 0; i < OBJECTS; i++) {
+        testassertequal([objs[i] retainCount], 1);
+        [objs[i] release];
+    }
+    testassertequal(deallocs, OBJECTS);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,117 @@
+// TEST_CONFIG MEM=mrc
+// TEST_ENV OBJC_SAMPLE_POOL_SITES=1
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// With every push sampled, each push site records the number of entries
+// pending when its pool is popped, tallied by class, and the pool's
+// high-water mark. Inner pools popped along with an outer pool are
+// recorded too.
+
+@interface Foo : NSObject @end
+@implementation Foo @end
+@interface Bar : NSObject @end
+@implementation Bar @end
+
+static uint64_t classCount(const objc_autoreleasepool_site_t *site, Class cls)
+{
+    for (unsigned i = 0; i < 8; i++) {
+        if (site->classes[i].cls == cls) return site->classes[i].count;
+    }
+    return 0;
+}
+
+static const objc_autoreleasepool_site_t *findSite(uint64_t maxEntries)
+{
+    static objc_autoreleasepool_site_t sites[64];
+    unsigned count = _objc_autoreleasePoolCopySites(sites, 64);
+    testassert(count <= 64);
+    for (unsigned i = 0; i < count; i++) {
+        if (sites[i].maxEntries == maxEntries) return &sites[i];
+    }
+    return NULL;
+}
+
+static void __attribute__((noinline)) bigPool(int foos)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < foos; i++) {
+        [[Foo new] autorelease];
+    }
+    for (int i = 0; i < 10; i++) {
+        [[Bar new] autorelease];
+    }
+    objc_autoreleasePoolPop(pool);
+}
+
+static void __attribute__((noinline)) nestedPools(void)
+{
+    void *outer = objc_autoreleasePoolPush();
+    for (int i = 0; i < 5; i++) {
+        [[Bar new] autorelease];
+    }
+    objc_autoreleasePoolPush();
+    for (int i = 0; i < 7; i++) {
+        [[Foo new] autorelease];
+    }
+    // Pops the inner pool too.
+    objc_autoreleasePoolPop(outer);
+}
+
+static void __attribute__((noinline)) drainedInnerPool(void)
+{
+    void *outer = objc_autoreleasePoolPush();
+    [[Bar new] autorelease];
+    void *inner = objc_autoreleasePoolPush();
+    for (int i = 0; i < 2000; i++) {
+        [[Foo new] autorelease];
+    }
+    objc_autoreleasePoolPop(inner);
+    [[Bar new] autorelease];
+    objc_autoreleasePoolPop(outer);
+}
+
+int main()
+{
+    void *pool = objc_autoreleasePoolPush();
+
+    bigPool(100);
+    bigPool(1000);
+    nestedPools();
+    drainedInnerPool();
+
+    const objc_autoreleasepool_site_t *big = findSite(1010);
+    testassert(big);
+    testassertequal(big->samples, 2);
+    testassertequal(big->totalEntries, 110 + 1010);
+    testassertequal(classCount(big, [Foo class]), 1100);
+    testassertequal(classCount(big, [Bar class]), 20);
+
+    // 5 Bars, the inner pool's boundary, and 7 Foos.
+    const objc_autoreleasepool_site_t *outer = findSite(13);
+    testassert(outer);
+    testassertequal(classCount(outer, [Bar class]), 5);
+    testassertequal(classCount(outer, [Foo class]), 7);
+
+    const objc_autoreleasepool_site_t *inner = findSite(7);
+    testassert(inner);
+    testassertequal(classCount(inner, [Foo class]), 7);
+    testassert(inner->address != outer->address);
+    testassert(inner->address != big->address);
+
+    // The outer pool's peak includes the inner pool's entries, which
+    // were released before the outer pool was popped.
+    const objc_autoreleasepool_site_t *drained = findSite(2002);
+    testassert(drained);
+    testassertequal(drained->totalEntries, 2);
+    testassertequal(classCount(drained, [Bar class]), 2);
+    testassertequal(classCount(drained, [Foo class]), 0);
+    const objc_autoreleasepool_site_t *drainedInner = findSite(2000);
+    testassert(drainedInner);
+    testassertequal(classCount(drainedInner, [Foo class]), 2000);
+
+    objc_autoreleasePoolPop(pool);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,76 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+// TEST_ENV OBJC_POOL_SPARE_PAGES=2
+
+#include "test.h"
+#include <objc/NSObject.h>
+#include <mach/vm_param.h>
+
+// Repeatedly pushing and popping a pool slightly larger than one page
+// must reuse the thread's spare pages instead of allocating new ones
+// when OBJC_POOL_SPARE_PAGES is set.
+// The spare pages are freed when the thread exits.
+
+#define OBJECTS (PAGE_MIN_SIZE / sizeof(id) + 100)
+#define CYCLES 100
+
+static objc_autoreleasepool_statistics_t stats(void)
+{
+    objc_autoreleasepool_statistics_t result;
+    _objc_autoreleasePoolGetStatistics(&result);
+    return result;
+}
+
+static void cycle(void)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (unsigned i = 0; i < OBJECTS; i++) {
+        [[NSObject new] autorelease];
+    }
+    objc_autoreleasePoolPop(pool);
+}
+
+static void *thread(void *arg __unused)
+{
+    void *pool = objc_autoreleasePoolPush();
+    for (int i = 0; i < CYCLES; i++) {
+        cycle();
+    }
+    objc_autoreleasePoolPop(pool);
+    return NULL;
+}
+
+int main()
+{
+    void *pool = objc_autoreleasePoolPush();
+
+    // Warm up the page chain.
+    cycle();
+
+    objc_autoreleasepool_statistics_t before = stats();
+    for (int i = 0; i < CYCLES; i++) {
+        cycle();
+    }
+    objc_autoreleasepool_statistics_t after = stats();
+
+    testprintf("allocated %llu, freed %llu, reused %llu\n",
+               after.pagesAllocated - before.pagesAllocated,
+               after.pagesFreed - before.pagesFreed,
+               after.pagesReused - before.pagesReused);
+    testassertequal(after.pagesAllocated, before.pagesAllocated);
+    testassertequal(after.pagesFreed, before.pagesFreed);
+    testassert(after.pagesReused - before.pagesReused >= CYCLES);
+
+    objc_autoreleasePoolPop(pool);
+
+    // Every page of an exited thread is freed, including its spare pages.
+    before = stats();
+    pthread_t th;
+    pthread_create(&th, NULL, thread, NULL);
+    pthread_join(th, NULL);
+    after = stats();
+    testassert(after.pagesAllocated > before.pagesAllocated);
+    testassertequal(after.pagesAllocated - before.pagesAllocated,
+                    after.pagesFreed - before.pagesFreed);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,76 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+// TEST_ENV OBJC_PROFILE_SYNC_CONTENTION=YES
+/*
+TEST_RUN_OUTPUT
+OK: synchronized-contention.m
+objc\[\d+\]: ##############
+objc\[\d+\]: SYNC CONTENTION \(1 locks\)
+objc\[\d+\]: SYNC 0x[0-9a-fA-F]+ Contended: 3 acquisitions, 1 contended, \d+ us waiting
+objc\[\d+\]: ##############
+END
+*/
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/objc-sync.h>
+#include <objc/NSObject.h>
+
+// Contended @synchronized locks are recorded with their class and wait
+// time, and logged at exit. Uncontended locks are counted but not logged.
+
+#define HOLD_USEC 100000
+
+@interface Contended : NSObject @end
+@implementation Contended @end
+@interface Uncontended : NSObject @end
+@implementation Uncontended @end
+
+static id contended;
+static id uncontended;
+static atomic_int started;
+
+static void *threadfn(void *arg __unused)
+{
+    started = 1;
+    testassert(objc_sync_enter(contended) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+int main()
+{
+    contended = [Contended new];
+    uncontended = [Uncontended new];
+
+    testassert(objc_sync_enter(uncontended) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(uncontended) == OBJC_SYNC_SUCCESS);
+
+    testassert(objc_sync_enter(contended) == OBJC_SYNC_SUCCESS);
+    pthread_t th;
+    pthread_create(&th, NULL, threadfn, NULL);
+    while (!started) usleep(1000);
+    usleep(HOLD_USEC);
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_SUCCESS);
+    pthread_join(th, NULL);
+
+    // Uncontended, but counted.
+    testassert(objc_sync_enter(contended) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(contended) == OBJC_SYNC_SUCCESS);
+
+    __block bool foundContended = false;
+    _objc_sync_enumerateContention(^(const objc_sync_contention_t *record) {
+        if (record->object == (__bridge const void *)contended) {
+            foundContended = true;
+            testassert(record->cls == [Contended class]);
+            testassertequal(record->acquisitions, 3);
+            testassertequal(record->contendedAcquisitions, 1);
+            testassert(record->waitNanoseconds >= HOLD_USEC / 2 * 1000);
+        } else if (record->object == (__bridge const void *)uncontended) {
+            testassertequal(record->contendedAcquisitions, 0);
+        }
+    });
+    testassert(foundContended);
+
+    succeed(__FILE__);
+}
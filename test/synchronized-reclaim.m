@@ -0,0 +1,84 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+// TEST_ENV OBJC_DISABLE_THIN_SYNC_LOCKS=YES
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/objc-sync.h>
+#include <objc/NSObject.h>
+
+// Synchronizing on many distinct objects, one or a few at a time, must not
+// leave a lock behind for each of them. Idle locks are reused or
+// reclaimed, so the lock tables stay sized by the number of locks in use.
+// Thin locks are disabled so that every lock goes through the tables.
+
+#define OBJECTS 200000
+#define THREADS 8
+#define HELD 64
+
+static void syncOnMany(int count)
+{
+    for (int i = 0; i < count; i++) {
+        id obj = [NSObject new];
+        testassert(objc_sync_enter(obj) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(obj) == OBJC_SYNC_SUCCESS);
+        [obj release];
+    }
+}
+
+static void *threadfn(void *arg __unused)
+{
+    syncOnMany(OBJECTS / THREADS);
+    return NULL;
+}
+
+int main()
+{
+    objc_sync_statistics_t stats;
+    _objc_sync_getStatistics(&stats);
+    size_t baseline = stats.liveEntries;
+
+    syncOnMany(OBJECTS);
+    _objc_sync_getStatistics(&stats);
+    testprintf("after %d objects: %zu live, %zu idle, %zu slots, "
+               "max probe %zu, %llu reclaimed\n",
+               OBJECTS, stats.liveEntries, stats.idleEntries,
+               stats.capacity, stats.maxProbeLength,
+               stats.entriesReclaimed);
+    testassertequal(stats.liveEntries, baseline);
+    testassert(stats.capacity < 4096);
+
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        pthread_create(&threads[t], NULL, &threadfn, NULL);
+    }
+    for (int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    _objc_sync_getStatistics(&stats);
+    testassertequal(stats.liveEntries, baseline);
+    testassert(stats.capacity < 4096);
+
+    // Many locks held at once are all live, and are found again by
+    // recursive acquisition after other objects come and go.
+    id held[HELD];
+    for (int i = 0; i < HELD; i++) {
+        held[i] = [NSObject new];
+        testassert(objc_sync_enter(held[i]) == OBJC_SYNC_SUCCESS);
+    }
+    syncOnMany(OBJECTS / 10);
+    _objc_sync_getStatistics(&stats);
+    testassertequal(stats.liveEntries, baseline + HELD);
+    for (int i = 0; i < HELD; i++) {
+        testassert(objc_sync_enter(held[i]) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(held[i]) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(held[i]) == OBJC_SYNC_SUCCESS);
+        testassert(objc_sync_exit(held[i]) ==
+                   OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+        [held[i] release];
+    }
+    _objc_sync_getStatistics(&stats);
+    testassertequal(stats.liveEntries, baseline);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,138 @@
+// TEST_CONFIG OS=!exclavekit
+
+#include "test.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <objc/runtime.h>
+#include <objc/objc-sync.h>
+#include <objc/NSObject.h>
+
+// synchronized benchmark
+// The synchronized-counter and synchronized-grid workloads at 1 to THREADS
+// threads, plus a per-thread private lock that is never contended.
+// Uncontended locks are taken thin; run with OBJC_DISABLE_THIN_SYNC_LOCKS=YES
+// to compare against always allocating a mutex.
+
+#if defined(__arm__)
+#define THREADS 16
+#else
+#define THREADS 64
+#endif
+#define COUNT 1024*8
+#define ROWS 4
+#define COLS 3
+
+static id counterLock;
+static int counter;
+static id gridLocks[ROWS][COLS];
+static int gridCounts[ROWS][COLS];
+
+static void *privatefn(void *arg __unused)
+{
+    id lock = [NSObject new];
+    int n = 0;
+    for (int i = 0; i < COUNT; i++) {
+        testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+        n++;
+        testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    }
+    testassert(n == COUNT);
+    return NULL;
+}
+
+static void *counterfn(void *arg)
+{
+    int depth = 1 + (int)(intptr_t)arg % 4;
+    for (int n = 0; n < COUNT; n++) {
+        for (int d = 0; d < depth; d++) {
+            testassert(objc_sync_enter(counterLock) == OBJC_SYNC_SUCCESS);
+        }
+        counter++;
+        for (int d = 0; d < depth; d++) {
+            testassert(objc_sync_exit(counterLock) == OBJC_SYNC_SUCCESS);
+        }
+    }
+    return NULL;
+}
+
+static void *gridfn(void *arg)
+{
+    int depth = 1 + (int)(intptr_t)arg % 4;
+    for (int n = 0; n < COUNT / 8; n++) {
+        int r = rand() % ROWS;
+        int c = rand() % COLS;
+        // Lock [r][0..c] in that order to prevent deadlock.
+        for (int l = 0; l <= c; l++) {
+            for (int d = 0; d < depth; d++) {
+                testassert(objc_sync_enter(gridLocks[r][l]) == OBJC_SYNC_SUCCESS);
+            }
+        }
+        gridCounts[r][c]++;
+        for (int l = 0; l <= c; l++) {
+            for (int d = 0; d < depth; d++) {
+                testassert(objc_sync_exit(gridLocks[r][l]) == OBJC_SYNC_SUCCESS);
+            }
+        }
+    }
+    return NULL;
+}
+
+static uint64_t run(void *(*fn)(void *), int count)
+{
+    pthread_t threads[THREADS];
+    uint64_t start = hires_time();
+    for (int t = 0; t < count; t++) {
+        pthread_create(&threads[t], NULL, fn, (void*)(intptr_t)t);
+    }
+    for (int t = 0; t < count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return hires_time() - start;
+}
+
+int main()
+{
+    counterLock = [NSObject new];
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            gridLocks[r][c] = [NSObject new];
+        }
+    }
+
+    for (int threads = 1; threads <= THREADS; threads *= 2) {
+        uint64_t privateTime = run(privatefn, threads);
+
+        counter = 0;
+        uint64_t counterTime = run(counterfn, threads);
+        testassert(counter == threads*COUNT);
+
+        bzero(gridCounts, sizeof(gridCounts));
+        uint64_t gridTime = run(gridfn, threads);
+        int total = 0;
+        for (int r = 0; r < ROWS; r++) {
+            for (int c = 0; c < COLS; c++) {
+                total += gridCounts[r][c];
+            }
+        }
+        testassert(total == threads*(COUNT/8));
+
+        testprintf("%2d threads: private %llu ns/lock, counter %llu ns/lock, "
+                   "grid %llu ns/op\n", threads,
+                   privateTime / ((uint64_t)threads*COUNT),
+                   counterTime / ((uint64_t)threads*COUNT),
+                   gridTime / ((uint64_t)threads*(COUNT/8)));
+    }
+
+    // Every lock must be available again.
+    testassert(objc_sync_try_enter(counterLock));
+    testassert(objc_sync_exit(counterLock) == OBJC_SYNC_SUCCESS);
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            testassert(objc_sync_try_enter(gridLocks[r][c]));
+            testassert(objc_sync_exit(gridLocks[r][c]) == OBJC_SYNC_SUCCESS);
+        }
+    }
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,153 @@
+// TEST_CONFIG OS=!exclavekit
+
+#include "test.h"
+
+#include <pthread.h>
+#include <objc/objc-sync.h>
+#include <objc/NSObject.h>
+
+// Shared @synchronized locks. Shared holders run at the same time and
+// exclude exclusive holders, and the other way around.
+
+#define READERS 8
+#define COUNT 1024*64
+
+static id lock;
+static atomic_int inside;
+static atomic_int entered;
+static int value;
+
+static void *allInsidefn(void *arg __unused)
+{
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    inside++;
+    // Every reader must get in while the others are still holding it.
+    for (int i = 0; i < 10000 && inside < READERS; i++) {
+        usleep(1000);
+    }
+    testassertequal(inside, READERS);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+static void *readerfn(void *arg __unused)
+{
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    entered++;
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    return NULL;
+}
+
+static void *tryWriterfn(void *arg __unused)
+{
+    return (void *)(intptr_t)objc_sync_try_enter(lock);
+}
+
+static void *readLoopfn(void *arg)
+{
+    bool shared = (bool)(intptr_t)arg;
+    int sum = 0;
+    for (int i = 0; i < COUNT; i++) {
+        if (shared) _objc_sync_enter_shared(lock);
+        else objc_sync_enter(lock);
+        sum += value;
+        if (shared) _objc_sync_exit_shared(lock);
+        else objc_sync_exit(lock);
+    }
+    testassertequal(sum, COUNT * value);
+    return NULL;
+}
+
+static uint64_t run(void *(*fn)(void *), int count, void *arg)
+{
+    pthread_t threads[READERS];
+    uint64_t start = hires_time();
+    for (int t = 0; t < count; t++) {
+        pthread_create(&threads[t], NULL, fn, arg);
+    }
+    for (int t = 0; t < count; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return hires_time() - start;
+}
+
+int main()
+{
+    lock = [NSObject new];
+    pthread_t th;
+    void *locked;
+
+    // Readers don't exclude each other.
+    run(allInsidefn, READERS, NULL);
+
+    // A writer excludes readers until it unlocks.
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    pthread_create(&th, NULL, readerfn, NULL);
+    usleep(100000);
+    testassertequal(entered, 0);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    pthread_join(th, NULL);
+    testassertequal(entered, 1);
+
+    // A reader excludes writers.
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    pthread_create(&th, NULL, tryWriterfn, NULL);
+    pthread_join(th, &locked);
+    testassert(!locked);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    pthread_create(&th, NULL, tryWriterfn, NULL);
+    pthread_join(th, &locked);
+    testassert(locked);
+
+    // That thread exited holding the lock. Use a new one from here on.
+    lock = [NSObject new];
+
+    // Shared inside exclusive, and recursive shared.
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+
+    // Unlocking what isn't held.
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+
+    // Unlocking in the wrong mode fails and leaves the lock held.
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    pthread_create(&th, NULL, tryWriterfn, NULL);
+    pthread_join(th, &locked);
+    testassert(!locked);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+
+    // The exclusive lock can't be unlocked under a shared lock nested in
+    // it. Holding another lock first keeps this one from being taken thin.
+    id outer = [NSObject new];
+    testassert(objc_sync_enter(outer) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_enter(lock) == OBJC_SYNC_SUCCESS);
+    testassert(_objc_sync_enter_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_NOT_OWNING_THREAD_ERROR);
+    testassert(_objc_sync_exit_shared(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(lock) == OBJC_SYNC_SUCCESS);
+    testassert(objc_sync_exit(outer) == OBJC_SYNC_SUCCESS);
+    pthread_create(&th, NULL, readerfn, NULL);
+    pthread_join(th, NULL);
+    testassertequal(entered, 2);
+
+    value = 3;
+    for (int threads = 1; threads <= READERS; threads *= 2) {
+        uint64_t exclusiveTime = run(readLoopfn, threads, (void *)0);
+        uint64_t sharedTime = run(readLoopfn, threads, (void *)1);
+        testprintf("%d readers: exclusive %llu ns, shared %llu ns\n",
+                   threads, exclusiveTime, sharedTime);
+    }
+
+    succeed(__FILE__);
+}
@@ -34,6 +34,7 @@ using std::memory_order_relaxed;
 #include <sys/param.h>
 
 #include <libgen.h>
+#include <time.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <mach/mach.h>
@@ -271,6 +272,17 @@ static inline void testwarn(const char *msg, ...)
 
 static inline void testnoop() { }
 
+#if !TARGET_OS_EXCLAVEKIT
+// Monotonic time in nanoseconds, for tests that measure how long
+// something takes.
+static inline uint64_t hires_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ((uint64_t)(1000000000)) * ts.tv_sec + ts.tv_nsec;
+}
+#endif
+
 // Are we running in dyld3 mode?
 // Note: checks by looking for the DYLD_USE_CLOSURES environment variable.
 // This is is always set by our test script, but this won't give the right
@@ -0,0 +1,87 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// Weak register/unregister/clear cost with 1, 4, 100, and 10000 referrers
+// per object. Also checks that every referrer is cleared, including after
+// the referrer table grows and shrinks again.
+
+#define MAX_REFERRERS 10000
+#define TRIALS 20
+
+static id vars[MAX_REFERRERS];
+
+static void measure(int count)
+{
+    uint64_t registerTime = UINT64_MAX;
+    uint64_t unregisterTime = UINT64_MAX;
+    uint64_t clearTime = UINT64_MAX;
+
+    for (int trial = 0; trial < TRIALS; trial++) {
+        id obj = [NSObject new];
+
+        uint64_t start = hires_time();
+        for (int i = 0; i < count; i++) {
+            objc_storeWeak(&vars[i], obj);
+        }
+        uint64_t t = hires_time() - start;
+        if (t < registerTime) registerTime = t;
+
+        // Unregister every other referrer, then register them again.
+        start = hires_time();
+        for (int i = 0; i < count; i += 2) {
+            objc_storeWeak(&vars[i], nil);
+        }
+        t = hires_time() - start;
+        if (t < unregisterTime) unregisterTime = t;
+        for (int i = 0; i < count; i += 2) {
+            objc_storeWeak(&vars[i], obj);
+        }
+
+        start = hires_time();
+        [obj release];
+        t = hires_time() - start;
+        if (t < clearTime) clearTime = t;
+
+        for (int i = 0; i < count; i++) {
+            testassert(vars[i] == nil);
+        }
+    }
+
+    testprintf("%5d referrers: register %llu ns, unregister half %llu ns, "
+               "clear %llu ns\n", count, registerTime, unregisterTime, clearTime);
+}
+
+static void shrinkAndClear(void)
+{
+    // Grow the referrer table, shrink it again, then clear.
+    id obj = [NSObject new];
+    for (int i = 0; i < MAX_REFERRERS; i++) {
+        objc_storeWeak(&vars[i], obj);
+    }
+    for (int i = 0; i < MAX_REFERRERS - 10; i++) {
+        objc_storeWeak(&vars[i], nil);
+    }
+    // objc_loadWeak autoreleases. Don't let the pool keep obj alive.
+    PUSH_POOL {
+        for (int i = MAX_REFERRERS - 10; i < MAX_REFERRERS; i++) {
+            testassert(objc_loadWeak(&vars[i]) == obj);
+        }
+    } POP_POOL;
+    [obj release];
+    for (int i = 0; i < MAX_REFERRERS; i++) {
+        testassert(vars[i] == nil);
+    }
+}
+
+int main()
+{
+    measure(1);
+    measure(4);
+    measure(100);
+    measure(MAX_REFERRERS);
+    shrinkAndClear();
+
+    succeed(__FILE__);
+}
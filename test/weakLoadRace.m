@@ -0,0 +1,95 @@
+// TEST_CONFIG MEM=mrc OS=!exclavekit
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// Stress objc_loadWeakRetained's lock-free path against concurrent
+// deallocation of the referent. Every load must return either nil or
+// an object that is still alive and correctly retained.
+
+#define READERS 8
+#define CYCLES 20000
+
+static id weakVar;
+static atomic_int liveObjects;
+static atomic_int done;
+static atomic_int strongLoads;
+static atomic_int customLoads;
+
+@interface Tracked : NSObject {
+@public
+    int magic;
+}
+@end
+@implementation Tracked
+-(id)init {
+    self = [super init];
+    magic = 0x5a5a5a5a;
+    liveObjects++;
+    return self;
+}
+-(void)dealloc {
+    testassert(magic == 0x5a5a5a5a);
+    magic = 0;
+    liveObjects--;
+    [super dealloc];
+}
+@end
+
+// Custom retainWeakReference always uses the locked path.
+@interface CustomWeak : Tracked @end
+@implementation CustomWeak
+-(BOOL)retainWeakReference {
+    customLoads++;
+    return [super retainWeakReference];
+}
+@end
+
+static void *reader(void *arg __unused)
+{
+    while (!done) {
+        Tracked *obj = objc_loadWeakRetained(&weakVar);
+        if (obj) {
+            testassert(obj->magic == 0x5a5a5a5a);
+            strongLoads++;
+            [obj release];
+        }
+    }
+    return NULL;
+}
+
+static void cycle(Class cls)
+{
+    id obj = [cls new];
+    objc_storeWeak(&weakVar, obj);
+    sched_yield();
+    [obj release];
+    testassert(objc_loadWeak(&weakVar) == nil);
+}
+
+int main()
+{
+    pthread_t threads[READERS];
+    for (int i = 0; i < READERS; i++) {
+        pthread_create(&threads[i], NULL, reader, NULL);
+    }
+
+    for (int i = 0; i < CYCLES; i++) {
+        cycle([Tracked class]);
+    }
+    for (int i = 0; i < CYCLES / 10; i++) {
+        cycle([CustomWeak class]);
+    }
+
+    done = 1;
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    objc_destroyWeak(&weakVar);
+
+    testassertequal(liveObjects, 0);
+    testprintf("%d strong loads, %d through retainWeakReference\n",
+               (int)strongLoads, (int)customLoads);
+
+    succeed(__FILE__);
+}
@@ -0,0 +1,81 @@
+// TEST_CONFIG MEM=mrc
+
+#include "test.h"
+#include <objc/NSObject.h>
+
+// Weak table statistics are kept as running counters, updated as weak
+// references are registered, unregistered, and cleared.
+
+#define OBJECTS 8
+
+static unsigned tableCount;
+
+static objc_weak_statistics_t total(void)
+{
+    objc_weak_statistics_t stats[tableCount];
+    testassertequal(_objc_weak_getStatistics(stats, tableCount), tableCount);
+
+    objc_weak_statistics_t sum;
+    bzero(&sum, sizeof(sum));
+    for (unsigned i = 0; i < tableCount; i++) {
+        sum.entries += stats[i].entries;
+        sum.referrers += stats[i].referrers;
+        testassert(stats[i].entries <= stats[i].capacity);
+        for (unsigned j = 0; j < 8; j++) {
+            sum.referrersHistogram[j] += stats[i].referrersHistogram[j];
+        }
+        sum.clearCount += stats[i].clearCount;
+        sum.growCount += stats[i].growCount;
+    }
+    return sum;
+}
+
+int main()
+{
+    tableCount = _objc_weak_getStatistics(NULL, 0);
+    testassert(tableCount > 0);
+
+    objc_weak_statistics_t before = total();
+
+    // Object i has (1 << i) weak references: 1, 2, 4, ... 128.
+    static id vars[OBJECTS][128];
+    id objs[OBJECTS];
+    for (int i = 0; i < OBJECTS; i++) {
+        objs[i] = [NSObject new];
+        for (int j = 0; j < (1 << i); j++) {
+            objc_storeWeak(&vars[i][j], objs[i]);
+        }
+    }
+
+    objc_weak_statistics_t during = total();
+    testassertequal(during.entries - before.entries, OBJECTS);
+    testassertequal(during.referrers - before.referrers, 255);
+    // 1 -> [0], 2 -> [1], 4 -> [2], 8 -> [3], 16 -> [4], 32 -> [5],
+    // 64 -> [6], 128 -> [7]
+    for (unsigned j = 0; j < 8; j++) {
+        testassertequal(during.referrersHistogram[j] - before.referrersHistogram[j], 1);
+    }
+
+    // Unregistering moves an object to a smaller bucket.
+    for (int j = 64; j < 128; j++) {
+        objc_storeWeak(&vars[OBJECTS - 1][j], nil);
+    }
+    objc_weak_statistics_t unregistered = total();
+    testassertequal(unregistered.referrers - before.referrers, 255 - 64);
+    testassertequal(unregistered.referrersHistogram[6] - before.referrersHistogram[6], 2);
+    testassertequal(unregistered.referrersHistogram[7], before.referrersHistogram[7]);
+
+    for (int i = 0; i < OBJECTS; i++) {
+        [objs[i] release];
+    }
+
+    objc_weak_statistics_t after = total();
+    testassertequal(after.entries, before.entries);
+    testassertequal(after.referrers, before.referrers);
+    for (unsigned j = 0; j < 8; j++) {
+        testassertequal(after.referrersHistogram[j], before.referrersHistogram[j]);
+    }
+    testassertequal(after.clearCount - before.clearCount, OBJECTS);
+
+    succeed(__FILE__);
+}
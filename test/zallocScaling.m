@@ -0,0 +1,76 @@
+// TEST_CONFIG MEM=mrc OS=watchos ARCH=armv7k,arm64_32
+
+#include "test.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <objc/runtime.h>
+#include <objc/NSObject.h>
+
+// class_rw_t allocation benchmark
+// Threads create, register, and dispose of class pairs, which allocate
+// and free class_rw_t and class_rw_ext_t from the runtime's zone
+// allocator. On these 32-bit targets both structures come from the
+// zone's global freelist (on LP64 their sizes are multiples of the malloc
+// alignment, so they use malloc directly). An element handed to two
+// threads at once would show up as another class's name or methods here.
+// Much of this time is spent under runtimeLock either way.
+
+#if defined(__arm__)
+#define THREADS 8
+#else
+#define THREADS 16
+#endif
+#define COUNT 256
+
+static IMP impFor(int t)
+{
+    return (IMP)(uintptr_t)(0x1000 + t * 0x10);
+}
+
+static void *threadfn(void *arg)
+{
+    int t = (int)(intptr_t)arg;
+    char name[64];
+    Class classes[COUNT];
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(name, sizeof(name), "ZallocScaling_%d_%d", t, i);
+        Class cls = objc_allocateClassPair([NSObject class], name, 0);
+        testassert(cls);
+        // Adding a method gives the class a class_rw_ext_t too.
+        class_addMethod(cls, @selector(description), impFor(t), "@@:");
+        objc_registerClassPair(cls);
+        classes[i] = cls;
+    }
+    for (int i = 0; i < COUNT; i++) {
+        snprintf(name, sizeof(name), "ZallocScaling_%d_%d", t, i);
+        Class cls = classes[i];
+        testassertequal(objc_getClass(name), cls);
+        testassertequalstr(class_getName(cls), name);
+        testassertequal(method_getImplementation(class_getInstanceMethod(cls, @selector(description))), impFor(t));
+        objc_disposeClassPair(cls);
+    }
+    return NULL;
+}
+
+int main()
+{
+    int run = 0;
+    for (int threads = 1; threads <= THREADS; threads *= 2) {
+        pthread_t th[THREADS];
+        uint64_t start = hires_time();
+        for (int t = 0; t < threads; t++) {
+            pthread_create(&th[t], NULL, threadfn,
+                           (void *)(intptr_t)(run * THREADS + t));
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(th[t], NULL);
+        }
+        uint64_t time = hires_time() - start;
+        testprintf("%2d threads: %llu ns/class\n", threads,
+                   time / ((uint64_t)threads * COUNT));
+        run++;
+    }
+
+    succeed(__FILE__);
+}